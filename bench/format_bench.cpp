@@ -0,0 +1,286 @@
+/**
+ * @brief Microbenchmark of text formatting.
+ *
+ * Compares BDF and hexadecimal formatters with the former snprintf based
+ * functions and checks that both produce identical output. PCI device
+ * descriptions are checked as well: out of range addresses must be rejected,
+ * valid ones must keep their names.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "format.hpp"
+#include "pcidevice.hpp"
+
+#include <endian.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+/** Number of BDF triples (bus, device and function numbers) */
+constexpr uint32_t BDF_SPACE = 1 << 24;
+/** Number of domain numbers */
+constexpr uint32_t DOMAIN_SPACE = 1 << 16;
+
+/** @brief Former short name formatter.
+ *
+ *  @param[in] domain - domain number
+ *  @param[in] bus - bus number
+ *  @param[in] device - device number
+ *  @param[in] function - function number
+ *
+ *  @return short name
+ */
+static std::string oldShortName(uint16_t domain, uint8_t bus, uint8_t device,
+                                uint8_t function)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "PCI%04x%02x%02x%x", domain, bus, device,
+             function);
+    return name;
+}
+
+/** @brief Former location formatter.
+ *
+ *  @param[in] domain - domain number
+ *  @param[in] bus - bus number
+ *  @param[in] device - device number
+ *  @param[in] function - function number
+ *
+ *  @return location
+ */
+static std::string oldLocation(uint16_t domain, uint8_t bus, uint8_t device,
+                               uint8_t function)
+{
+    char location[16];
+    snprintf(location, sizeof(location), "%04x:%02x:%02x.%x", domain, bus,
+             device, function);
+    return location;
+}
+
+/** @brief Former hexadecimal formatter.
+ *
+ *  @param[in] val - value to convert
+ *  @param[in] bits - number of significant bits
+ *
+ *  @return hexadecimal string representation of the source value
+ */
+template <typename T>
+static std::string oldToHex(T val, uint8_t bits = sizeof(T) * BITS_PER_BYTE)
+{
+    const int sbytes =
+        bits / (BITS_PER_BYTE / 2) + (bits % (BITS_PER_BYTE / 2) ? 1 : 0);
+    const uint8_t shift = sizeof(val) * BITS_PER_BYTE - bits;
+    val &= std::numeric_limits<T>::max() >> shift;
+    std::string text(sbytes + 3, 0);
+    const int pl = snprintf(&text[0], text.size(), "0x%0*x", sbytes, val);
+    text.resize(static_cast<size_t>(pl));
+    return text;
+}
+
+/** @brief Split the index of the BDF space into PCI address.
+ *
+ *  Each BDF triple is checked once, domain number is changed on each step,
+ *  so every domain number is checked with 256 different triples.
+ *
+ *  @param[in] index - index in the BDF space
+ *  @param[out] domain - domain number
+ *  @param[out] bus - bus number
+ *  @param[out] device - device number
+ *  @param[out] function - function number
+ */
+static void splitIndex(uint32_t index, uint16_t& domain, uint8_t& bus,
+                       uint8_t& device, uint8_t& function)
+{
+    domain = static_cast<uint16_t>(index * 0x9e37);
+    bus = static_cast<uint8_t>(index >> 16);
+    device = static_cast<uint8_t>(index >> 8);
+    function = static_cast<uint8_t>(index);
+}
+
+/** @brief Check BDF formatter over the whole bus, device and function
+ *         numbers space and all domain numbers.
+ *
+ *  @return number of mismatches
+ */
+static size_t checkBdf()
+{
+    size_t mismatches = 0;
+    for (uint32_t i = 0; i < BDF_SPACE; ++i)
+    {
+        uint16_t domain;
+        uint8_t bus, device, function;
+        splitIndex(i, domain, bus, device, function);
+
+        char name[BDF_TEXT_SIZE];
+        char location[BDF_TEXT_SIZE];
+        formatBdf(domain, bus, device, function, name, location);
+        if (oldShortName(domain, bus, device, function) != name ||
+            oldLocation(domain, bus, device, function) != location)
+        {
+            if (!mismatches)
+            {
+                fprintf(stderr, "BDF mismatch: %04x:%02x:%02x.%x: %s %s\n",
+                        domain, bus, device, function, name, location);
+            }
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+/** @brief Check PCI device descriptions over the whole bus, device and
+ *         function numbers space.
+ *
+ *  @return number of mismatches
+ */
+static size_t checkDevice()
+{
+    size_t mismatches = 0;
+    for (uint32_t i = 0; i < BDF_SPACE; ++i)
+    {
+        IpmiPciDevice msg{};
+        uint16_t domain;
+        splitIndex(i, domain, msg.busNumber, msg.deviceNumber,
+                   msg.functionNumber);
+        msg.domainNumber = htobe16(domain);
+        // Class code of every second description exceeds 24 bits
+        const uint32_t classCode = (i & 0xffffff) | ((i & 1) << 24);
+        msg.classCode = htobe32(classCode);
+
+        const bool valid = msg.deviceNumber <= 0x1f &&
+                           msg.functionNumber <= 0x07 && !(i & 1);
+        bool match = PciDevice::isValid(msg) == valid;
+        if (match && valid)
+        {
+            std::string name, location;
+            const PciDevice dev(msg);
+            dev.getNames(name, location);
+            match = dev.classCode == classCode &&
+                    name == oldShortName(domain, msg.busNumber,
+                                         msg.deviceNumber,
+                                         msg.functionNumber) &&
+                    location == oldLocation(domain, msg.busNumber,
+                                            msg.deviceNumber,
+                                            msg.functionNumber);
+        }
+        if (!match)
+        {
+            if (!mismatches)
+            {
+                fprintf(stderr, "Device mismatch: %04x:%02x:%02x.%x %08x\n",
+                        domain, msg.busNumber, msg.deviceNumber,
+                        msg.functionNumber, classCode);
+            }
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+/** @brief Check hexadecimal formatter over the whole space of the value.
+ *
+ *  @param[in] bits - number of significant bits
+ *
+ *  @return number of mismatches
+ */
+template <typename T>
+static size_t checkHex(uint8_t bits = sizeof(T) * BITS_PER_BYTE)
+{
+    size_t mismatches = 0;
+    const uint32_t space = 1u << bits;
+    for (uint32_t i = 0; i < space; ++i)
+    {
+        const T val = static_cast<T>(i);
+        const std::string text = toHex<T>(val, bits);
+        if (text != oldToHex<T>(val, bits))
+        {
+            if (!mismatches)
+            {
+                fprintf(stderr, "Hex mismatch: %x (%u bits): %s\n", i, bits,
+                        text.c_str());
+            }
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+/** @brief Measure average time of the function call.
+ *
+ *  @param[in] name - name of the measurement
+ *  @param[in] count - number of calls
+ *  @param[in] func - function to call, gets the call index
+ */
+template <typename F>
+static void measure(const char* name, uint32_t count, F&& func)
+{
+    const auto start = std::chrono::steady_clock::now();
+    size_t sum = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        sum += func(i);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const double ns =
+        std::chrono::duration<double, std::nano>(elapsed).count() / count;
+    printf("%-24s %8.1f ns/call (checksum %zu)\n", name, ns, sum);
+}
+
+int main()
+{
+    size_t mismatches = checkBdf();
+    mismatches += checkDevice();
+    mismatches += checkHex<uint8_t>();
+    mismatches += checkHex<uint16_t>();
+    mismatches += checkHex<uint32_t>(24);
+    if (mismatches)
+    {
+        fprintf(stderr, "%zu mismatches found\n", mismatches);
+        return 1;
+    }
+    printf("Output is identical for %u addresses and all hex values\n",
+           BDF_SPACE);
+
+    measure("snprintf names", BDF_SPACE, [](uint32_t i) {
+        uint16_t domain;
+        uint8_t bus, device, function;
+        splitIndex(i, domain, bus, device, function);
+        return oldShortName(domain, bus, device, function).size() +
+               oldLocation(domain, bus, device, function).size();
+    });
+    measure("formatBdf names", BDF_SPACE, [](uint32_t i) {
+        uint16_t domain;
+        uint8_t bus, device, function;
+        splitIndex(i, domain, bus, device, function);
+        char name[BDF_TEXT_SIZE];
+        char location[BDF_TEXT_SIZE];
+        const size_t len =
+            formatBdf(domain, bus, device, function, name, location);
+        return std::string(name, len).size() +
+               std::string(location, len).size();
+    });
+    measure("snprintf hex", DOMAIN_SPACE, [](uint32_t i) {
+        return oldToHex(static_cast<uint16_t>(i)).size() +
+               oldToHex(i, 24).size();
+    });
+    measure("toHex", DOMAIN_SPACE, [](uint32_t i) {
+        return toHex(static_cast<uint16_t>(i)).size() + toHex(i, 24).size();
+    });
+
+    return 0;
+}
@@ -0,0 +1,269 @@
+/**
+ * @brief Microbenchmark of the inventory batches.
+ *
+ * Compares the former eager batches, which kept DBus objects built on each
+ * update, with the lazy ones, which keep compact records and build objects
+ * only when the batch is written. Host sessions which are reset or whose
+ * updates are coalesced before the write are measured: CPU time, heap held
+ * by the batch waiting to be written and peak heap usage. Both paths must
+ * write identical objects.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "objectbuilder.hpp"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <new>
+
+/** Number of PCI functions in the host's list */
+constexpr uint32_t DEVICES = 1024;
+/** Number of times the list is sent between writes */
+constexpr uint32_t ROUNDS = 8;
+/** Number of scenario runs to measure time */
+constexpr uint32_t RUNS = 20;
+/** IPMI channel of the host */
+constexpr uint8_t CHANNEL = 0x0f;
+
+/** Heap usage counters */
+static size_t heapUsed = 0;
+static size_t heapPeak = 0;
+
+void* operator new(size_t size)
+{
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    heapUsed += malloc_usable_size(ptr);
+    if (heapUsed > heapPeak)
+    {
+        heapPeak = heapUsed;
+    }
+    return ptr;
+}
+
+// Not inlined, so the compiler doesn't match free() with operator new
+__attribute__((noinline)) void operator delete(void* ptr) noexcept
+{
+    if (ptr)
+    {
+        heapUsed -= malloc_usable_size(ptr);
+        free(ptr);
+    }
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+using Object = ObjectBuilder::Object;
+
+/** @class EagerBatch
+ *  @brief Former batch: DBus object is built on each update, coalescing
+ *         replaces objects with the same path.
+ */
+class EagerBatch
+{
+  public:
+    EagerBatch(const ObjectBuilder& builder) : builder_(builder)
+    {
+    }
+
+    void reset()
+    {
+        objects_.clear();
+    }
+
+    void add(const PciDevice& dev)
+    {
+        for (auto& it : builder_.createFromDevice(dev))
+        {
+            objects_.insert_or_assign(it.first, std::move(it.second));
+        }
+    }
+
+    Object write()
+    {
+        Object objects = std::move(objects_);
+        objects_.clear();
+        return objects;
+    }
+
+  private:
+    const ObjectBuilder& builder_;
+    Object objects_;
+};
+
+/** @class LazyBatch
+ *  @brief Current batch: compact records, DBus objects are built only when
+ *         the batch is written.
+ */
+class LazyBatch
+{
+  public:
+    LazyBatch(const ObjectBuilder& builder) : builder_(builder)
+    {
+    }
+
+    void reset()
+    {
+        records_.clear();
+    }
+
+    void add(const PciDevice& dev)
+    {
+        records_.devices.insert_or_assign(dev.getKey(), dev);
+    }
+
+    Object write()
+    {
+        Object objects = builder_.createObjects(records_, nullptr);
+        records_.clear();
+        return objects;
+    }
+
+  private:
+    const ObjectBuilder& builder_;
+    ObjectRecords records_;
+};
+
+/** @brief Construct description of the PCI function.
+ *
+ *  @param[in] index - index of the function in the host's list
+ *  @param[in] round - number of the round, changes the description
+ *
+ *  @return PCI device description
+ */
+static PciDevice makeDevice(uint32_t index, uint32_t round)
+{
+    // Functions are spread over buses and devices of the first domain
+    PciDevice dev(((index >> 5) << 8) | ((index & 0x1f) << 3));
+    dev.vendorId = 0x8086;
+    dev.deviceId = static_cast<uint16_t>(index);
+    dev.classCode = 0x020000 | (index & 0xff);
+    dev.revision = round;
+    return dev;
+}
+
+/** @brief Host resends its list after reset several times while the batch
+ *         is not written, only the last list is written.
+ *
+ *  @param[in] batch - batch to fill
+ */
+template <typename Batch>
+static void resetSession(Batch& batch)
+{
+    for (uint32_t round = 0; round < ROUNDS; ++round)
+    {
+        batch.reset();
+        for (uint32_t i = 0; i < DEVICES; ++i)
+        {
+            batch.add(makeDevice(i, round));
+        }
+    }
+}
+
+/** @brief Each function is updated several times while the batch is not
+ *         written, only the latest state is written.
+ *
+ *  @param[in] batch - batch to fill
+ */
+template <typename Batch>
+static void coalescedSession(Batch& batch)
+{
+    for (uint32_t i = 0; i < DEVICES; ++i)
+    {
+        for (uint32_t round = 0; round < ROUNDS; ++round)
+        {
+            batch.add(makeDevice(i, round));
+        }
+    }
+}
+
+/** @brief Run the scenario and write the batch, print time and heap usage.
+ *
+ *  @param[in] name - name of the measurement
+ *  @param[in] scenario - scenario to run, gets the batch to fill
+ *
+ *  @return objects written by the last run
+ */
+template <typename Batch, typename F>
+static Object measure(const char* name, F&& scenario)
+{
+    const ObjectBuilder builder(CHANNEL);
+    Object objects;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t run = 0; run < RUNS; ++run)
+    {
+        Batch batch(builder);
+        scenario(batch);
+        objects = batch.write();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Heap is measured on a separate run, peak includes written objects
+    objects.clear();
+    const size_t base = heapUsed;
+    heapPeak = base;
+    size_t held;
+    {
+        Batch batch(builder);
+        scenario(batch);
+        held = heapUsed - base;
+        objects = batch.write();
+    }
+    const size_t peak = heapPeak - base;
+
+    const double ms =
+        std::chrono::duration<double, std::milli>(elapsed).count() / RUNS;
+    printf("%-20s %8.2f ms/session %6zu KiB held %6zu KiB peak\n", name, ms,
+           held / 1024, peak / 1024);
+    return objects;
+}
+
+int main()
+{
+    size_t mismatches = 0;
+
+    Object eager = measure<EagerBatch>(
+        "eager reset", [](EagerBatch& batch) { resetSession(batch); });
+    Object lazy = measure<LazyBatch>(
+        "lazy reset", [](LazyBatch& batch) { resetSession(batch); });
+    if (eager != lazy || eager.size() != DEVICES)
+    {
+        fprintf(stderr, "Reset session: written objects differ\n");
+        ++mismatches;
+    }
+
+    eager = measure<EagerBatch>(
+        "eager coalesced", [](EagerBatch& batch) { coalescedSession(batch); });
+    lazy = measure<LazyBatch>(
+        "lazy coalesced", [](LazyBatch& batch) { coalescedSession(batch); });
+    if (eager != lazy || eager.size() != DEVICES)
+    {
+        fprintf(stderr, "Coalesced session: written objects differ\n");
+        ++mismatches;
+    }
+
+    return mismatches ? 1 : 0;
+}
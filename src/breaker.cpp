@@ -0,0 +1,103 @@
+/**
+ * @brief Circuit breaker of inventory manager calls.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "breaker.hpp"
+
+#include <phosphor-logging/log.hpp>
+
+using namespace phosphor::logging;
+
+/** Number of failed calls in a row to open the breaker */
+constexpr size_t FAILURE_THRESHOLD = 3;
+/** Cool down period of the open breaker */
+constexpr std::chrono::seconds COOL_DOWN(10);
+
+CircuitBreaker::CircuitBreaker(Status& status, Callback&& onClosed) :
+    status_(status), onClosed_(std::move(onClosed))
+{
+}
+
+CircuitBreaker::Permit CircuitBreaker::allow()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    switch (state_)
+    {
+        case Status::Breaker::closed:
+            return Permit::granted;
+        case Status::Breaker::open:
+            if (Clock::now() - openTime_ < COOL_DOWN)
+            {
+                return Permit::denied;
+            }
+            // The caller becomes the only one who probes the manager
+            setState(Status::Breaker::halfOpen);
+            return Permit::probe;
+        default:
+            return Permit::denied;
+    }
+}
+
+void CircuitBreaker::success()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    failures_ = 0;
+    if (state_ != Status::Breaker::closed)
+    {
+        const auto stall = Clock::now() - stallTime_;
+        status_.stallTime +=
+            std::chrono::duration_cast<std::chrono::microseconds>(stall)
+                .count();
+        status_.stallStart = 0;
+        setState(Status::Breaker::closed);
+        lock.unlock();
+        log<level::INFO>("Inventory manager is available, publishing resumed");
+        // Callback takes the owner's locks, don't hold the breaker one
+        onClosed_();
+    }
+}
+
+void CircuitBreaker::failure()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ++failures_;
+    if (state_ == Status::Breaker::halfOpen ||
+        (state_ == Status::Breaker::closed && failures_ >= FAILURE_THRESHOLD))
+    {
+        openTime_ = Clock::now();
+        if (state_ == Status::Breaker::closed)
+        {
+            stallTime_ = openTime_;
+            status_.stallStart =
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    stallTime_.time_since_epoch())
+                    .count();
+            log<level::ERR>("Inventory manager is unavailable, "
+                            "publishing parked");
+        }
+        setState(Status::Breaker::open);
+    }
+}
+
+void CircuitBreaker::setState(Status::Breaker state)
+{
+    state_ = state;
+    status_.breaker = state;
+}
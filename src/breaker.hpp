@@ -0,0 +1,97 @@
+/**
+ * @brief Circuit breaker of inventory manager calls.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "status.hpp"
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+/** @class CircuitBreaker
+ *  @brief Tracks health of the inventory manager.
+ *
+ *  After several failed calls in a row the breaker opens: publishing is
+ *  parked until the cool down period expires. Then a single caller gets
+ *  permission to probe the inventory manager, success of the probe closes
+ *  the breaker, failure opens it again. Owner of the breaker is notified
+ *  when publishing is resumed, so it can retry everything parked so far.
+ *  The breaker is shared by all host sessions.
+ */
+class CircuitBreaker
+{
+  public:
+    /** @brief Permission to call the inventory manager. */
+    enum class Permit
+    {
+        /** @brief Call is not allowed, publishing is parked. */
+        denied,
+        /** @brief Call is allowed. */
+        granted,
+        /** @brief Call is allowed after probing the inventory manager. */
+        probe
+    };
+
+    using Callback = std::function<void()>;
+
+    /** @brief Constructor.
+     *
+     *  @param[in] status - inventory status to update
+     *  @param[in] onClosed - callback called when the open breaker becomes
+     *                        closed, it is called without the breaker lock
+     */
+    CircuitBreaker(Status& status, Callback&& onClosed);
+
+    /** @brief Get permission to call the inventory manager.
+     *
+     *  @return permission
+     */
+    Permit allow();
+
+    /** @brief Register successful call. */
+    void success();
+
+    /** @brief Register failed call. */
+    void failure();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    /** @brief Set the breaker state.
+     *
+     *  @param[in] state - new state
+     */
+    void setState(Status::Breaker state);
+
+  private:
+    /** @brief Inventory status. */
+    Status& status_;
+    /** @brief Callback: the breaker has been closed. */
+    Callback onClosed_;
+    /** @brief Current state. */
+    Status::Breaker state_ = Status::Breaker::closed;
+    /** @brief Number of failed calls in a row. */
+    size_t failures_ = 0;
+    /** @brief Time of the last breaker opening. */
+    Clock::time_point openTime_;
+    /** @brief Time of the first breaker opening after it was closed. */
+    Clock::time_point stallTime_;
+    /** @brief Synchronization object. */
+    std::mutex mutex_;
+};
@@ -0,0 +1,81 @@
+/**
+ * @brief Fingerprint of the PCI device list.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fingerprint.hpp"
+
+#include <endian.h>
+
+/** FNV-1a parameters */
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+Fingerprint::Fingerprint() : count_(0), hash_(FNV_OFFSET_BASIS)
+{
+}
+
+Fingerprint::Fingerprint(const IpmiPciFingerprint& msg) :
+    count_(be32toh(msg.count)), hash_(be64toh(msg.hash))
+{
+}
+
+void Fingerprint::add(const PciDevice& dev)
+{
+    // Descriptions are validated on receiving, so the native form gives the
+    // same bytes as the message
+    ++count_;
+    update(dev.getDomain());
+    update(dev.getBus());
+    update(dev.getDevice());
+    update(dev.getFunction());
+    update(dev.vendorId);
+    update(dev.deviceId);
+    update(static_cast<uint32_t>(dev.classCode));
+    update(static_cast<uint8_t>(dev.revision));
+}
+
+void Fingerprint::add(const PciVfRange& range)
+{
+    add(range.base);
+    count_ += range.count - 1;
+    update(range.count);
+    update(range.offset);
+    update(range.stride);
+}
+
+IpmiPciFingerprint Fingerprint::toIpmi() const
+{
+    IpmiPciFingerprint msg;
+    msg.count = htobe32(count_);
+    msg.hash = htobe64(hash_);
+    return msg;
+}
+
+bool Fingerprint::operator==(const Fingerprint& other) const
+{
+    return count_ == other.count_ && hash_ == other.hash_;
+}
+
+template <typename T>
+void Fingerprint::update(T val)
+{
+    for (size_t i = sizeof(T); i; --i)
+    {
+        hash_ ^= static_cast<uint8_t>(val >> ((i - 1) * 8));
+        hash_ *= FNV_PRIME;
+    }
+}
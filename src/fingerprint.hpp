@@ -0,0 +1,78 @@
+/**
+ * @brief Fingerprint of the PCI device list.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ipmi.hpp"
+#include "pcidevice.hpp"
+
+/** @class Fingerprint
+ *  @brief Fingerprint of the PCI device list: number of PCI functions and
+ *         hash (64-bit FNV-1a) of the list records.
+ *
+ *  Records are hashed in the format they are sent over IPMI (BE byte order):
+ *  PCI devices sorted by address, then VF ranges sorted by the physical
+ *  function address. The host calculates the fingerprint of its list in the
+ *  same way, so both sides can check if the lists are equal.
+ */
+class Fingerprint
+{
+  public:
+    /** @brief Constructor, creates fingerprint of an empty list. */
+    Fingerprint();
+
+    /** @brief Constructor.
+     *
+     *  @param[in] msg - fingerprint from IPMI message
+     */
+    Fingerprint(const IpmiPciFingerprint& msg);
+
+    /** @brief Add PCI device record.
+     *
+     *  @param[in] dev - PCI device description
+     */
+    void add(const PciDevice& dev);
+
+    /** @brief Add SR-IOV virtual functions range record.
+     *
+     *  @param[in] range - virtual functions range
+     */
+    void add(const PciVfRange& range);
+
+    /** @brief Convert fingerprint to IPMI message format.
+     *
+     *  @return fingerprint in IPMI message format
+     */
+    IpmiPciFingerprint toIpmi() const;
+
+    bool operator==(const Fingerprint& other) const;
+
+  private:
+    /** @brief Update hash with the value in BE byte order.
+     *
+     *  @param[in] val - value to hash
+     */
+    template <typename T>
+    void update(T val);
+
+  private:
+    /** @brief Number of PCI functions. */
+    uint32_t count_;
+    /** @brief Hash of the list records. */
+    uint64_t hash_;
+};
@@ -0,0 +1,133 @@
+/**
+ * @brief Text formatting helpers.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <string>
+
+/** @brief Lookup table of lowercase hexadecimal digits. */
+constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+/** @brief Bits per byte. */
+constexpr uint8_t BITS_PER_BYTE = 8;
+
+/** @brief Buffer size enough to hold any BDF text with terminating null. */
+constexpr size_t BDF_TEXT_SIZE = 16;
+
+/** @brief Write a fixed number of hexadecimal digits.
+ *
+ *  @param[out] out - output buffer
+ *  @param[in] val - value to convert
+ *  @param[in] digits - number of digits to write (leading zeros included)
+ *
+ *  @return pointer to the position next to the last written digit
+ */
+constexpr char* formatHex(char* out, uint32_t val, size_t digits)
+{
+    for (size_t i = digits; i; --i)
+    {
+        out[i - 1] = HEX_DIGITS[val & 0xf];
+        val >>= 4;
+    }
+    return out + digits;
+}
+
+/** @brief Format PCI address as a short name ("PCIddddbbddf") and as a
+ *         location ("dddd:bb:dd.f") in one pass.
+ *
+ *  Output is the same as "PCI%04x%02x%02x%x" and "%04x:%02x:%02x.%x" formats
+ *  of snprintf produce.
+ *
+ *  @param[in] domain - domain number
+ *  @param[in] bus - bus number
+ *  @param[in] device - device number
+ *  @param[in] function - function number
+ *  @param[out] name - buffer for the short name
+ *  @param[out] location - buffer for the location
+ *
+ *  @return length of the short name, the location has the same length
+ */
+constexpr size_t formatBdf(uint16_t domain, uint8_t bus, uint8_t device,
+                           uint8_t function, char (&name)[BDF_TEXT_SIZE],
+                           char (&location)[BDF_TEXT_SIZE])
+{
+    // Digits of all numbers in the order they are printed
+    const uint32_t values[] = {domain, bus, device, function};
+    const size_t widths[] = {4, 2, 2, function > 0xf ? 2u : 1u};
+    const char delimiters[] = {':', ':', '.', 0};
+
+    name[0] = 'P';
+    name[1] = 'C';
+    name[2] = 'I';
+    size_t np = 3;
+    size_t lp = 0;
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+        for (size_t d = widths[i]; d; --d)
+        {
+            const char digit = HEX_DIGITS[(values[i] >> ((d - 1) * 4)) & 0xf];
+            name[np++] = digit;
+            location[lp++] = digit;
+        }
+        if (delimiters[i])
+        {
+            location[lp++] = delimiters[i];
+        }
+    }
+
+    name[np] = 0;
+    location[lp] = 0;
+
+    return np;
+}
+
+/** @brief Convert number to a hexadecimal string.
+ *
+ *  Output is the same as "0x%0*x" format of snprintf produces for the
+ *  significant bits of the value.
+ *
+ *  @param[in] val - value to convert
+ *  @param[in] bits - number of significant bits
+ *
+ *  @return hexadecimal string representation of the source value
+ */
+template <typename T>
+std::string toHex(T val, uint8_t bits = sizeof(T) * BITS_PER_BYTE)
+{
+    // Number of significant bytes, we can't show less than half byte
+    const int sbytes =
+        bits / (BITS_PER_BYTE / 2) + (bits % (BITS_PER_BYTE / 2) ? 1 : 0);
+
+    // Remove non-significant bits
+    const uint8_t shift = sizeof(val) * BITS_PER_BYTE - bits;
+    val &= std::numeric_limits<T>::max() >> shift;
+
+    // Construct text string, prefix (0x) + digits are short enough to fit
+    // into the string object without heap allocation
+    char text[2 + sizeof(T) * 2];
+    text[0] = '0';
+    text[1] = 'x';
+    const char* end = formatHex(text + 2, val, sbytes);
+
+    return std::string(static_cast<const char*>(text), end);
+}
@@ -18,8 +18,12 @@
 
 #include "inventory.hpp"
 
-#include <limits>
+#ifdef PCIINV_OBJECT_SERVER
+#include "objectserver.hpp"
+#endif
+
 #include <phosphor-logging/log.hpp>
+#include <stdexcept>
 
 using namespace phosphor::logging;
 
@@ -27,155 +31,303 @@ using namespace phosphor::logging;
 static const char* ObjectMapperPath = "/xyz/openbmc_project/object_mapper";
 static const char* ObjectMapperIface = "xyz.openbmc_project.ObjectMapper";
 
+/** DBus Peer interface */
+static const char* PeerIface = "org.freedesktop.DBus.Peer";
+
+/** DBus call timeouts */
+constexpr uint64_t NOTIFY_TIMEOUT_US = PCIINV_NOTIFY_TIMEOUT * 1000ull;
+constexpr uint64_t MAPPER_TIMEOUT_US = PCIINV_MAPPER_TIMEOUT * 1000ull;
+
 /** DBus Inventory interface */
 static const char* InventoryPath = "/xyz/openbmc_project/inventory";
 static const char* InventoryIface = "xyz.openbmc_project.Inventory.Manager";
-static const char* CommonInventoryItem = "xyz.openbmc_project.Inventory.Item";
 static const char* PciInventoryItem = "xyz.openbmc_project.Inventory.Item.PCI";
-static const char* PciInventoryRoot = "/system/chassis/motherboard/";
-
-/** Properties from xyz.openbmc_project.Inventory.Item interface */
-static const char* PropPresent = "Present";
-static const char* PropPrettyName = "PrettyName";
-/** Properties from xyz.openbmc_project.Inventory.PCI interface */
-static const char* PropLocation = "Location";
-static const char* PropDeviceID = "DeviceID";
-static const char* PropVendorID = "VendorID";
-static const char* PropRevision = "Revision";
-static const char* PropClassCode = "ClassCode";
-
-/** Bits per byte */
-constexpr uint8_t BITS_PER_BYTE = 8;
-
-/** @brief Convert number to a hexadecimal string.
- *
- *  @param[in] val - value to convert
- *  @param[in] bits - number of significant bits
- *
- *  @return hexadecimal string representation of the source value
- */
-template <typename T>
-static std::string toHex(T val, uint8_t bits = sizeof(T) * BITS_PER_BYTE)
+
+/** Maximum number of objects written to the inventory at once */
+constexpr size_t BATCH_SIZE = 32;
+
+Inventory::Inventory(uint8_t channel, ObjectServer* server,
+                     CircuitBreaker& breaker) :
+    builder_(channel), server_(server), breaker_(breaker)
 {
-    // Number of significant bytes, we can't show less than half byte
-    const int sbytes =
-        bits / (BITS_PER_BYTE / 2) + (bits % (BITS_PER_BYTE / 2) ? 1 : 0);
+}
 
-    // Remove non-significant bits
-    const uint8_t shift = sizeof(val) * BITS_PER_BYTE - bits;
-    val &= std::numeric_limits<T>::max() >> shift;
+void Inventory::reset()
+{
+    log<level::INFO>("Reset PCI inventory",
+                     entry("ROOT=%s", builder_.getRoot().c_str()));
 
-    // Construct text string
-    std::string text(sbytes + 3, 0); // 3 = prefix (0x) + terminating null byte
-    const int pl = snprintf(&text[0], text.size(), "0x%0*x", sbytes, val);
-    text.resize(static_cast<size_t>(pl));
+    batch_.clear();
+    published_.clear();
+    parked_.clear();
+#ifdef PCIINV_OBJECT_SERVER
+    if (server_)
+    {
+        server_->markStale(builder_.getRoot());
+        return;
+    }
+#endif
 
-    return text;
+    // Existing objects will be reset before the next write
+    pendingReset_ = true;
 }
 
-Inventory::Inventory() : bus_{sdbusplus::bus::new_default()}
+void Inventory::sweep()
 {
+#ifdef PCIINV_OBJECT_SERVER
+    if (server_)
+    {
+        log<level::INFO>("Remove stale PCI inventory objects",
+                         entry("ROOT=%s", builder_.getRoot().c_str()));
+        server_->sweep(builder_.getRoot());
+    }
+#endif
 }
 
-void Inventory::reset()
+void Inventory::flush()
+{
+#ifdef PCIINV_OBJECT_SERVER
+    if (server_)
+    {
+        if (!batch_.empty())
+        {
+            std::vector<std::string> removed;
+            Object objects = builder_.createObjects(batch_, &removed);
+            batch_.clear();
+            if (!removed.empty())
+            {
+                server_->erase(std::move(removed));
+            }
+            if (!objects.empty())
+            {
+                server_->publish(std::move(objects));
+            }
+        }
+        return;
+    }
+#endif
+
+    // Coalesce updates, only the latest state of each object is written
+    parked_.merge(std::move(batch_));
+    if (parked_.empty() && !pendingReset_)
+    {
+        return;
+    }
+
+    // Object mapper failures don't affect the breaker of the inventory
+    // manager, the reset is retried with the parked objects
+    Object placeholders;
+    if (pendingReset_)
+    {
+        try
+        {
+            placeholders = createPlaceholders();
+        }
+        catch (const std::exception& e)
+        {
+            log<level::ERR>("Failed to enumerate PCI inventory",
+                            entry("ROOT=%s", builder_.getRoot().c_str()),
+                            entry("EXCEPTION=%s", e.what()));
+            return;
+        }
+    }
+
+    const CircuitBreaker::Permit permit = breaker_.allow();
+    if (permit == CircuitBreaker::Permit::denied)
+    {
+        return;
+    }
+
+    try
+    {
+        if (permit == CircuitBreaker::Permit::probe)
+        {
+            probe();
+        }
+        if (pendingReset_)
+        {
+            saveObjects(std::move(placeholders));
+            pendingReset_ = false;
+        }
+        // Chunks which are written don't need to be written again
+        while (!parked_.empty())
+        {
+            Records chunk = parked_.split(BATCH_SIZE);
+            try
+            {
+                saveObject(builder_.createObjects(chunk, nullptr));
+            }
+            catch (const std::exception&)
+            {
+                parked_.merge(std::move(chunk));
+                throw;
+            }
+            published_.merge(std::move(chunk));
+        }
+        breaker_.success();
+    }
+    catch (const std::exception& e)
+    {
+        log<level::ERR>("Failed to write PCI device description to inventory",
+                        entry("ROOT=%s", builder_.getRoot().c_str()),
+                        entry("EXCEPTION=%s", e.what()));
+        breaker_.failure();
+    }
+}
+
+bool Inventory::isParked() const
 {
-    log<level::INFO>("Reset PCI inventory");
+    return !parked_.empty() || pendingReset_;
+}
+
+bool Inventory::republish()
+{
+    if (server_ || published_.empty())
+    {
+        return false;
+    }
+    log<level::INFO>("Republish PCI inventory",
+                     entry("ROOT=%s", builder_.getRoot().c_str()),
+                     entry("OBJECTS=%zu", published_.size()));
+
+    // Parked objects are newer than the published ones
+    Records records = std::move(published_);
+    published_.clear();
+    records.merge(std::move(parked_));
+    parked_ = std::move(records);
+    flush();
+    return true;
+}
 
-    // Get all existing PCI devices from inventory
-    auto method = bus_.new_method_call(ObjectMapperIface, ObjectMapperPath,
-                                       ObjectMapperIface, "GetSubTreePaths");
+void Inventory::add(const PciDevice& dev)
+{
+    batch_.devices.insert_or_assign(dev.getKey(), dev);
+    limitBatch();
+}
+
+void Inventory::add(const PciVfRange& range)
+{
+#ifdef PCIINV_VF_AGGREGATE
+    batch_.ranges.insert_or_assign(range.base.getKey(), range);
+    limitBatch();
+#else
+    for (uint16_t i = 0; i < range.count; ++i)
+    {
+        add(range.getFunction(i));
+    }
+#endif
+}
+
+void Inventory::remove(const PciDevice& dev)
+{
+    batch_.devices.insert_or_assign(dev.getKey(), std::nullopt);
+    limitBatch();
+}
+
+void Inventory::remove(const PciVfRange& range)
+{
+#ifdef PCIINV_VF_AGGREGATE
+    batch_.ranges.insert_or_assign(range.base.getKey(), std::nullopt);
+    limitBatch();
+#else
+    for (uint16_t i = 0; i < range.count; ++i)
+    {
+        remove(range.getFunction(i));
+    }
+#endif
+}
+
+void Inventory::limitBatch()
+{
+    if (batch_.size() >= BATCH_SIZE)
+    {
+        flush();
+    }
+}
+
+sdbusplus::bus::bus& Inventory::getBus()
+{
+    // Connection is opened by the working thread on the first call, so
+    // creating a session is cheap and doesn't touch DBus
+    if (!bus_)
+    {
+        bus_.emplace(sdbusplus::bus::new_system());
+    }
+    return *bus_;
+}
+
+Inventory::Object Inventory::createPlaceholders()
+{
+    // Get all existing PCI devices from the inventory, the host's subtree
+    // may not exist yet and querying it would fail
+    const std::string subtree = InventoryPath + builder_.getRoot();
+    sdbusplus::bus::bus& bus = getBus();
+    auto method = bus.new_method_call(ObjectMapperIface, ObjectMapperPath,
+                                      ObjectMapperIface, "GetSubTreePaths");
     method.append(std::string(InventoryPath));
     method.append(0);
     method.append(std::vector<std::string>({PciInventoryItem}));
-    auto response = bus_.call(method);
+    auto response = bus.call(method, MAPPER_TIMEOUT_US);
     if (response.is_method_error())
     {
-        log<level::ERR>("Failed to enumerate PCI inventory");
-        return;
+        throw std::runtime_error("Failed to enumerate PCI inventory");
     }
 
     // Enumerate PCI devices and reset state (save empty data)
     std::vector<std::string> paths;
     response.read(paths);
     const size_t rootPartLen = strlen(InventoryPath);
+    Object empty;
     for (auto it = paths.begin(); it != paths.end(); ++it)
     {
+        // Skip objects of other hosts with similar path prefix
+        if (it->compare(0, subtree.length(), subtree) != 0)
+        {
+            continue;
+        }
         // Remove root part from inventory path
         const std::string path = it->substr(rootPartLen);
         // Reset state - it's impossible to remove inventory item, so we
         // write an empty description to corresponded path
-        Object obj = createEmpty(path);
-        saveObject(obj);
+        empty.merge(ObjectBuilder::createEmpty(path));
     }
+    return empty;
 }
 
-void Inventory::add(const PciDevice& dev)
-{
-    Object obj = createFromDevice(dev);
-    saveObject(obj);
-}
-
-Inventory::Object Inventory::createFromDevice(const PciDevice& dev) const
+void Inventory::probe()
 {
-    const std::string objectPath = PciInventoryRoot + dev.getShortName();
-    // clang-format off
-    Object obj = {{
-        objectPath, {
-            {
-                CommonInventoryItem, {
-                    { PropPresent, true },
-                    { PropPrettyName, dev.getPrettyName() }
-                }
-            },
-            {
-                PciInventoryItem, {
-                    { PropLocation, dev.getLocation() },
-                    { PropDeviceID, toHex(dev.deviceId) },
-                    { PropVendorID, toHex(dev.vendorId) },
-                    { PropRevision, toHex(dev.revision) },
-                    { PropClassCode, toHex(dev.classCode, 24) }
-                }
-            }
-        }
-    }};
-    return obj;
-    // clang-format on
+    sdbusplus::bus::bus& bus = getBus();
+    auto method = bus.new_method_call(InventoryIface, InventoryPath,
+                                      PeerIface, "Ping");
+    auto response = bus.call(method, NOTIFY_TIMEOUT_US);
+    if (response.is_method_error())
+    {
+        throw std::runtime_error("Inventory manager doesn't respond");
+    }
 }
 
-Inventory::Object Inventory::createEmpty(const std::string& path) const
+void Inventory::saveObjects(Object&& objects)
 {
-    // clang-format off
-    Object obj = {{
-        path, {
-            {
-                CommonInventoryItem, {
-                    { PropPresent, false },
-                    { PropPrettyName, std::string() }
-                }
-            },
-            {
-                PciInventoryItem, {
-                    { PropLocation, std::string() },
-                    { PropDeviceID, std::string() },
-                    { PropVendorID, std::string() },
-                    { PropRevision, std::string() },
-                    { PropClassCode, std::string() }
-                }
-            }
+    while (!objects.empty())
+    {
+        Object chunk;
+        while (!objects.empty() && chunk.size() < BATCH_SIZE)
+        {
+            chunk.insert(objects.extract(objects.begin()));
         }
-    }};
-    return obj;
-    // clang-format on
+        saveObject(chunk);
+    }
 }
 
 void Inventory::saveObject(const Object& obj)
 {
-    auto method = bus_.new_method_call(InventoryIface, InventoryPath,
-                                       InventoryIface, "Notify");
+    sdbusplus::bus::bus& bus = getBus();
+    auto method = bus.new_method_call(InventoryIface, InventoryPath,
+                                      InventoryIface, "Notify");
     method.append(obj);
-    auto response = bus_.call(method);
+    auto response = bus.call(method, NOTIFY_TIMEOUT_US);
     if (response.is_method_error())
     {
-        log<level::ERR>("Failed to write PCI device description to inventory");
+        throw std::runtime_error("Inventory manager returned an error");
     }
 }
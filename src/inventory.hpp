@@ -18,60 +18,166 @@
 
 #pragma once
 
+#include "breaker.hpp"
+#include "objectbuilder.hpp"
 #include "pcidevice.hpp"
 
+#include <map>
+#include <optional>
 #include <sdbusplus/bus.hpp>
 
+class ObjectServer;
+
 /** @class Inventory
  *  @brief PCI inventory support.
+ *
+ *  Each host has its own inventory subtree, the subtree is chosen by the IPMI
+ *  channel number the host uses to send PCI device list.
+ *  Objects are collected into batches and written to the inventory all at
+ *  once, either via inventory manager or via own object server. Batches keep
+ *  compact device descriptions, DBus objects with their text properties are
+ *  constructed only when the batch is really written.
  */
 class Inventory
 {
   public:
-    /** @brief Constructor. */
-    Inventory();
+    /** @brief Constructor.
+     *
+     *  @param[in] channel - IPMI channel number of the host
+     *  @param[in] server - object server hosting PCI objects, nullptr to
+     *                      write objects via inventory manager
+     *  @param[in] breaker - circuit breaker of inventory manager calls
+     */
+    Inventory(uint8_t channel, ObjectServer* server, CircuitBreaker& breaker);
 
     /** @brief Reset the PCI device objects description in the inventory.
      *         The function removes all properties and sets the Present flag to
-     *         false for all existing PCI devices in the inventory.
+     *         false for all existing PCI devices in the host's subtree.
+     *         Objects hosted by own object server are marked as stale, they
+     *         are updated in place if they are written again.
+     *         Inventory manager objects are reset by the next flush.
      */
     void reset();
 
+    /** @brief Remove hosted objects which haven't been written since the
+     *         last reset. Inventory manager objects are already reset.
+     */
+    void sweep();
+
+    /** @brief Write the current batch of added objects to the inventory.
+     *         While the inventory manager is unhealthy, objects are parked:
+     *         only the latest state of each object is kept and the whole set
+     *         is written when the manager recovers, in chunks of the batch
+     *         size.
+     */
+    void flush();
+
+    /** @brief Check if there are parked objects waiting to be written.
+     *
+     *  @return true if the inventory has parked objects
+     */
+    bool isParked() const;
+
+    /** @brief Write all objects written since the last reset to the
+     *         inventory again at once.
+     *         Used to restore the inventory after the inventory manager
+     *         restart, does nothing if objects are hosted by own server.
+     *
+     *  @return true if there were objects to write again
+     */
+    bool republish();
+
     /** @brief Add PCI device to the inventory.
      *
      *  @param[in] dev - PCI device description
      */
     void add(const PciDevice& dev);
 
+    /** @brief Add SR-IOV virtual functions to the inventory.
+     *         Depending on the build configuration, each VF is published as
+     *         a separate object (in batches) or the whole range is published
+     *         as a single aggregate object.
+     *
+     *  @param[in] range - virtual functions range
+     */
+    void add(const PciVfRange& range);
+
+    /** @brief Remove PCI device from the inventory.
+     *
+     *  @param[in] dev - PCI device description
+     */
+    void remove(const PciDevice& dev);
+
+    /** @brief Remove SR-IOV virtual functions from the inventory.
+     *
+     *  @param[in] range - virtual functions range
+     */
+    void remove(const PciVfRange& range);
+
   private:
-    using Properties =
-        std::map<std::string, sdbusplus::message::variant<std::string, bool>>;
-    using Interfaces = std::map<std::string, Properties>;
-    using Object = std::map<sdbusplus::message::object_path, Interfaces>;
+    using Object = ObjectBuilder::Object;
+    using Records = ObjectRecords;
 
-    /** @brief Create an inventory object from PCI device description.
+    /** @brief Flush the current batch if it becomes full. */
+    void limitBatch();
+
+    /** @brief Get DBus connection, open it on the first call.
      *
-     *  @param[in] obj - PCI device description
+     *  @return DBus connection
      *
-     *  @return inventory object
+     *  @throw std::exception if the connection can't be opened
      */
-    Object createFromDevice(const PciDevice& dev) const;
+    sdbusplus::bus::bus& getBus();
 
-    /** @brief Create an empty inventory object.
+    /** @brief Create empty descriptions of all existing objects of the
+     *         host's subtree in the inventory manager, used to reset them.
      *
-     *  @param[in] path - path to the PCI device object description
+     *  @return empty inventory objects
      *
-     *  @return inventory object
+     *  @throw std::exception if the object mapper fails
      */
-    Object createEmpty(const std::string& path) const;
+    Object createPlaceholders();
+
+    /** @brief Check if the inventory manager is responsive.
+     *
+     *  @throw std::exception if the manager doesn't respond
+     */
+    void probe();
 
     /** @brief Save the object to the inventory.
      *
      *  @param[in] obj - inventory object to save
+     *
+     *  @throw std::exception in case of errors
      */
     void saveObject(const Object& obj);
 
+    /** @brief Save objects to the inventory in chunks, so each call fits
+     *         its deadline regardless of the number of objects.
+     *
+     *  @param[in] objects - inventory objects to save
+     *
+     *  @throw std::exception in case of errors
+     */
+    void saveObjects(Object&& objects);
+
   private:
-    /** @brief DBus connection. */
-    sdbusplus::bus::bus bus_;
+    /** @brief DBus connection, opened on the first call. */
+    std::optional<sdbusplus::bus::bus> bus_;
+    /** @brief Builder of the host's PCI inventory objects. */
+    ObjectBuilder builder_;
+    /** @brief Object server, nullptr if inventory manager is used. */
+    ObjectServer* server_;
+    /** @brief Circuit breaker of inventory manager calls. */
+    CircuitBreaker& breaker_;
+    /** @brief Pending event: reset existing objects before the next write. */
+    bool pendingReset_ = false;
+    /** @brief Objects waiting to be written. */
+    Records batch_;
+    /** @brief Objects written to the inventory manager since the last reset,
+     *         ready to be sent again.
+     */
+    Records published_;
+    /** @brief Objects waiting for the inventory manager recovery. */
+    Records parked_;
 };
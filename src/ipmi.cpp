@@ -18,41 +18,224 @@
 
 #include "ipmi.hpp"
 
+#include "fingerprint.hpp"
 #include "workqueue.hpp"
 
+#include <endian.h>
+
 #include <ipmid/api.hpp>
 #include <phosphor-logging/log.hpp>
 
 using namespace phosphor::logging;
 
-/** @brief Working queue. */
+/** @brief Working queue of all host sessions. */
 WorkQueue workQueue_;
 
+/** @brief Check PCI device description received from the host.
+ *
+ *  @param[in] channel - IPMI channel number of the host
+ *  @param[in] dev - PCI device description from IPMI message
+ *
+ *  @return false if the description is invalid
+ */
+static bool checkDevice(uint8_t channel, const IpmiPciDevice& dev)
+{
+    if (PciDevice::isValid(dev))
+    {
+        return true;
+    }
+    log<level::ERR>("Invalid PCI device description",
+                    entry("CHANNEL=%u", channel),
+                    entry("DEVICE=%u", dev.deviceNumber),
+                    entry("FUNCTION=%u", dev.functionNumber),
+                    entry("CLASS=0x%08x", be32toh(dev.classCode)));
+    return false;
+}
+
 /** @brief Callback - IPMI OEM message handler.
  *
  *  Unfortunately, current IPMI API can't work with structures in input
  *  parameters, to solve this problem we use fixed size array which will be
  *  interpreted as a pointer to OEM packet.
  *
+ *  @param[in] ctx - IPMI request context
  *  @param[in] payload - message's payload data
  */
 static ipmi::RspType<> pciInventoryHandler(
+    ipmi::Context::ptr ctx,
     const std::array<uint8_t, sizeof(IpmiPciMessage)>& payload)
 {
     const IpmiPciMessage* pack =
         reinterpret_cast<const IpmiPciMessage*>(payload.data());
 
+    if (!checkDevice(ctx->channel, pack->device))
+    {
+        return ipmi::responseInvalidFieldRequest();
+    }
+
     if (pack->reset)
     {
-        workQueue_.reset();
+        workQueue_.reset(ctx->channel);
+    }
+
+    const PciDevice dev(pack->device);
+    if (!workQueue_.push(ctx->channel, dev))
+    {
+        log<level::ERR>("Virtual function can't be described apart from "
+                        "its range",
+                        entry("CHANNEL=%u", ctx->channel),
+                        entry("FUNCTION=%s", dev.getShortName().c_str()));
+        return ipmi::responseInvalidFieldRequest();
+    }
+
+    return ipmi::responseSuccess();
+}
+
+/** @brief Callback - IPMI OEM message handler for SR-IOV VF range.
+ *
+ *  @param[in] ctx - IPMI request context
+ *  @param[in] payload - message's payload data
+ */
+static ipmi::RspType<> pciVfRangeHandler(
+    ipmi::Context::ptr ctx,
+    const std::array<uint8_t, sizeof(IpmiPciVfMessage)>& payload)
+{
+    const IpmiPciVfMessage* pack =
+        reinterpret_cast<const IpmiPciVfMessage*>(payload.data());
+
+    if (!checkDevice(ctx->channel, pack->device))
+    {
+        return ipmi::responseInvalidFieldRequest();
+    }
+
+    const PciVfRange range(*pack);
+    if (!range.isValid())
+    {
+        log<level::ERR>("Invalid SR-IOV VF range",
+                        entry("COUNT=%u", range.count),
+                        entry("OFFSET=%u", range.offset),
+                        entry("STRIDE=%u", range.stride));
+        return ipmi::responseInvalidFieldRequest();
+    }
+
+    if (!workQueue_.push(ctx->channel, range))
+    {
+        log<level::ERR>("SR-IOV VF range overlaps PCI functions",
+                        entry("CHANNEL=%u", ctx->channel),
+                        entry("FUNCTION=%s",
+                              range.base.getShortName().c_str()));
+        return ipmi::responseInvalidFieldRequest();
+    }
+
+    return ipmi::responseSuccess();
+}
+
+/** @brief Callback - IPMI OEM message handler for fingerprint query.
+ *
+ *  The host sends fingerprint of its PCI device list, if it is equal to the
+ *  fingerprint of the list received by BMC, the host doesn't send the list
+ *  again. The query is read-only, it doesn't change the BMC's state.
+ *
+ *  @param[in] ctx - IPMI request context
+ *  @param[in] payload - message's payload data
+ *
+ *  @return fingerprint of the list received by BMC
+ */
+static ipmi::RspType<std::array<uint8_t, sizeof(IpmiPciFingerprint)>>
+    pciFingerprintHandler(
+        ipmi::Context::ptr ctx,
+        const std::array<uint8_t, sizeof(IpmiPciFingerprint)>& payload)
+{
+    const IpmiPciFingerprint* pack =
+        reinterpret_cast<const IpmiPciFingerprint*>(payload.data());
+
+    const Fingerprint host(*pack);
+    const Fingerprint bmc = workQueue_.getFingerprint(ctx->channel);
+    if (host == bmc)
+    {
+        log<level::INFO>("PCI device list is up to date",
+                         entry("CHANNEL=%u", ctx->channel));
     }
 
-    workQueue_.push(pack->device);
+    std::array<uint8_t, sizeof(IpmiPciFingerprint)> response;
+    *reinterpret_cast<IpmiPciFingerprint*>(response.data()) = bmc.toIpmi();
+
+    return ipmi::responseSuccess(response);
+}
+
+/** @brief Callback - IPMI OEM message handler for incremental change.
+ *
+ *  @param[in] ctx - IPMI request context
+ *  @param[in] payload - message's payload data
+ */
+static ipmi::RspType<> pciUpdateHandler(
+    ipmi::Context::ptr ctx,
+    const std::array<uint8_t, sizeof(IpmiPciUpdateMessage)>& payload)
+{
+    const IpmiPciUpdateMessage* pack =
+        reinterpret_cast<const IpmiPciUpdateMessage*>(payload.data());
+
+    if (!checkDevice(ctx->channel, pack->device))
+    {
+        return ipmi::responseInvalidFieldRequest();
+    }
+
+    const PciDevice dev(pack->device);
+
+    switch (pack->operation)
+    {
+        case PCIINV_OP_ADD:
+        case PCIINV_OP_UPDATE:
+            if (pack->scope != PCIINV_SCOPE_FUNCTION)
+            {
+                return ipmi::responseInvalidFieldRequest();
+            }
+            if (!workQueue_.push(ctx->channel, dev))
+            {
+                log<level::ERR>("Virtual function can't be described apart "
+                                "from its range",
+                                entry("CHANNEL=%u", ctx->channel),
+                                entry("FUNCTION=%s",
+                                      dev.getShortName().c_str()));
+                return ipmi::responseInvalidFieldRequest();
+            }
+            break;
+        case PCIINV_OP_REMOVE:
+        {
+            uint32_t mask;
+            switch (pack->scope)
+            {
+                case PCIINV_SCOPE_FUNCTION:
+                    mask = 0xffffffff;
+                    break;
+                case PCIINV_SCOPE_BUS:
+                    mask = 0xffffff00;
+                    break;
+                case PCIINV_SCOPE_DOMAIN:
+                    mask = 0xffff0000;
+                    break;
+                default:
+                    return ipmi::responseInvalidFieldRequest();
+            }
+            if (!workQueue_.remove(ctx->channel, dev.getKey(), mask))
+            {
+                log<level::ERR>("Virtual function can't be removed apart "
+                                "from its range",
+                                entry("CHANNEL=%u", ctx->channel),
+                                entry("FUNCTION=%s",
+                                      dev.getShortName().c_str()));
+                return ipmi::responseInvalidFieldRequest();
+            }
+            break;
+        }
+        default:
+            return ipmi::responseInvalidFieldRequest();
+    }
 
     return ipmi::responseSuccess();
 }
 
-/** @brief Register IPMI OEM message handler. */
+/** @brief Register IPMI OEM message handlers. */
 void registerPciInventoryHandler() __attribute__((constructor));
 void registerPciInventoryHandler()
 {
@@ -60,4 +243,13 @@ void registerPciInventoryHandler()
     ipmi::registerOemHandler(ipmi::prioOpenBmcBase, PCIINV_IANA_YADRO,
                              PCIINV_IPMI_CMD, ipmi::Privilege::Admin,
                              pciInventoryHandler);
+    ipmi::registerOemHandler(ipmi::prioOpenBmcBase, PCIINV_IANA_YADRO,
+                             PCIINV_IPMI_CMD_VF, ipmi::Privilege::Admin,
+                             pciVfRangeHandler);
+    ipmi::registerOemHandler(ipmi::prioOpenBmcBase, PCIINV_IANA_YADRO,
+                             PCIINV_IPMI_CMD_FINGERPRINT,
+                             ipmi::Privilege::Admin, pciFingerprintHandler);
+    ipmi::registerOemHandler(ipmi::prioOpenBmcBase, PCIINV_IANA_YADRO,
+                             PCIINV_IPMI_CMD_UPDATE, ipmi::Privilege::Admin,
+                             pciUpdateHandler);
 }
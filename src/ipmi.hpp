@@ -24,6 +24,22 @@
 constexpr uint8_t PCIINV_IPMI_NETFN = 0x2e;
 /** @brief Command number used to send PCI device description. */
 constexpr uint8_t PCIINV_IPMI_CMD = 0x2a;
+/** @brief Command number used to send SR-IOV virtual functions range. */
+constexpr uint8_t PCIINV_IPMI_CMD_VF = 0x2b;
+/** @brief Command number used to query PCI device list fingerprint. */
+constexpr uint8_t PCIINV_IPMI_CMD_FINGERPRINT = 0x2c;
+/** @brief Command number used to send incremental PCI device list change. */
+constexpr uint8_t PCIINV_IPMI_CMD_UPDATE = 0x2d;
+
+/** @brief Operations of incremental change. */
+constexpr uint8_t PCIINV_OP_ADD = 0;
+constexpr uint8_t PCIINV_OP_REMOVE = 1;
+constexpr uint8_t PCIINV_OP_UPDATE = 2;
+
+/** @brief Scopes of incremental change. */
+constexpr uint8_t PCIINV_SCOPE_FUNCTION = 0;
+constexpr uint8_t PCIINV_SCOPE_BUS = 1;
+constexpr uint8_t PCIINV_SCOPE_DOMAIN = 2;
 /** @brief IANA number of YADRO, used to identify OEM command group. */
 constexpr uint16_t PCIINV_IANA_YADRO = 49769;
 
@@ -36,15 +52,15 @@ struct IpmiPciDevice
     uint16_t domainNumber;
     /** @brief Bus number. */
     uint8_t busNumber;
-    /** @brief Device number. */
+    /** @brief Device number (0-31). */
     uint8_t deviceNumber;
-    /** @brief Function number. */
+    /** @brief Function number (0-7). */
     uint8_t functionNumber;
     /** @brief Vendor Id. */
     uint16_t vendorId;
     /** @brief Device Id. */
     uint16_t deviceId;
-    /** @brief Device class code. */
+    /** @brief Device class code, the most significant byte must be zero. */
     uint32_t classCode;
     /** @brief Revision number. */
     uint8_t revision;
@@ -67,3 +83,61 @@ struct IpmiPciMessage
     /** @brief PCI device description. */
     IpmiPciDevice device;
 } __attribute__((packed));
+
+/** @struct IpmiPciVfMessage
+ *  @brief IPMI OEM message packet with SR-IOV virtual functions range.
+ *
+ *  Describes a set of virtual functions of the same physical function in a
+ *  single message instead of sending each VF separately. The device
+ *  description contains address of the physical function and identifiers of
+ *  its virtual functions. Routing Id (bus, device and function numbers) of
+ *  the VF with index N is calculated in the same way as it is defined by
+ *  SR-IOV specification: PF Routing Id + First VF Offset + N * VF Stride.
+ *  All numbers come in BE byte order.
+ */
+struct IpmiPciVfMessage
+{
+    /** @brief Physical function address and VF description. */
+    IpmiPciDevice device;
+    /** @brief Number of virtual functions. */
+    uint16_t vfCount;
+    /** @brief Offset of the first VF Routing Id. */
+    uint16_t vfOffset;
+    /** @brief Distance between Routing Ids of consecutive VFs. */
+    uint16_t vfStride;
+} __attribute__((packed));
+
+/** @struct IpmiPciFingerprint
+ *  @brief Fingerprint of the PCI device list (in BE byte order).
+ *
+ *  Used both in the request and in the response of the fingerprint query:
+ *  the host sends the fingerprint of its own list, the BMC responds with the
+ *  fingerprint of the list it has received. If they are equal, the host
+ *  doesn't need to send the list again.
+ */
+struct IpmiPciFingerprint
+{
+    /** @brief Number of PCI functions in the list. */
+    uint32_t count;
+    /** @brief Hash of the list records. */
+    uint64_t hash;
+} __attribute__((packed));
+
+/** @struct IpmiPciUpdateMessage
+ *  @brief IPMI OEM message packet with incremental PCI device list change.
+ *
+ *  Used to report PCIe hot-plug events without resending the whole list.
+ *  Add and update operations are applied to a single PCI function. Remove
+ *  operation can be applied to a single function, to all functions on the
+ *  bus, or to all functions in the domain; VF range of the removed physical
+ *  function is removed as well.
+ */
+struct IpmiPciUpdateMessage
+{
+    /** @brief Operation: add, remove or update. */
+    uint8_t operation;
+    /** @brief Scope of the operation: function, bus or domain. */
+    uint8_t scope;
+    /** @brief PCI device description, only address is used by remove. */
+    IpmiPciDevice device;
+} __attribute__((packed));
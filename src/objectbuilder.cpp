@@ -0,0 +1,252 @@
+/**
+ * @brief Builder of PCI inventory objects.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "objectbuilder.hpp"
+
+#include "format.hpp"
+
+/** DBus Inventory interfaces */
+static const char* CommonInventoryItem = "xyz.openbmc_project.Inventory.Item";
+static const char* PciInventoryItem = "xyz.openbmc_project.Inventory.Item.PCI";
+
+/** Roots of the hosts' PCI inventory subtrees */
+static const char* PciInventoryRoot = "/system/chassis/motherboard/";
+static const char* PciHostRootPrefix = "/system/chassis/host";
+static const char* PciHostRootSuffix = "/motherboard/";
+
+/** IPMI channel of the system interface, used by the primary host */
+constexpr uint8_t SYSTEM_INTERFACE_CHANNEL = 0x0f;
+
+/** Properties from xyz.openbmc_project.Inventory.Item interface */
+static const char* PropPresent = "Present";
+static const char* PropPrettyName = "PrettyName";
+/** Properties from xyz.openbmc_project.Inventory.PCI interface */
+static const char* PropLocation = "Location";
+static const char* PropDeviceID = "DeviceID";
+static const char* PropVendorID = "VendorID";
+static const char* PropRevision = "Revision";
+static const char* PropClassCode = "ClassCode";
+
+/** Suffix of the aggregate VF range object name */
+static const char* VfRangeSuffix = "_VF";
+
+bool ObjectRecords::empty() const
+{
+    return devices.empty() && ranges.empty();
+}
+
+size_t ObjectRecords::size() const
+{
+    return devices.size() + ranges.size();
+}
+
+void ObjectRecords::clear()
+{
+    devices.clear();
+    ranges.clear();
+}
+
+void ObjectRecords::merge(ObjectRecords&& newer)
+{
+    for (auto& it : newer.devices)
+    {
+        devices.insert_or_assign(it.first, std::move(it.second));
+    }
+    for (auto& it : newer.ranges)
+    {
+        ranges.insert_or_assign(it.first, std::move(it.second));
+    }
+    newer.clear();
+}
+
+ObjectRecords ObjectRecords::split(size_t number)
+{
+    ObjectRecords head;
+    while (!devices.empty() && head.size() < number)
+    {
+        head.devices.insert(devices.extract(devices.begin()));
+    }
+    while (!ranges.empty() && head.size() < number)
+    {
+        head.ranges.insert(ranges.extract(ranges.begin()));
+    }
+    return head;
+}
+
+ObjectBuilder::ObjectBuilder(uint8_t channel)
+{
+    // The primary host keeps the traditional inventory path, other hosts
+    // have separate subtrees, so resetting one of them doesn't affect others
+    if (channel == SYSTEM_INTERFACE_CHANNEL)
+    {
+        root_ = PciInventoryRoot;
+    }
+    else
+    {
+        root_ =
+            PciHostRootPrefix + std::to_string(channel) + PciHostRootSuffix;
+    }
+}
+
+const std::string& ObjectBuilder::getRoot() const
+{
+    return root_;
+}
+
+ObjectBuilder::Object
+    ObjectBuilder::createObjects(const ObjectRecords& records,
+                                 std::vector<std::string>* removed) const
+{
+    // Objects of inventory manager can't be removed, they are replaced with
+    // empty descriptions
+    Object objects;
+    for (const auto& it : records.devices)
+    {
+        if (it.second)
+        {
+            objects.merge(createFromDevice(*it.second));
+        }
+        else if (removed)
+        {
+            removed->push_back(getDevicePath(it.first));
+        }
+        else
+        {
+            objects.merge(createEmpty(getDevicePath(it.first)));
+        }
+    }
+    for (const auto& it : records.ranges)
+    {
+        if (it.second)
+        {
+            objects.merge(createFromRange(*it.second));
+        }
+        else if (removed)
+        {
+            removed->push_back(getRangePath(it.first));
+        }
+        else
+        {
+            objects.merge(createEmpty(getRangePath(it.first)));
+        }
+    }
+    return objects;
+}
+
+ObjectBuilder::Object
+    ObjectBuilder::createFromDevice(const PciDevice& dev) const
+{
+    std::string shortName;
+    std::string location;
+    dev.getNames(shortName, location);
+    const std::string objectPath = root_ + shortName;
+    // clang-format off
+    Object obj = {{
+        objectPath, {
+            {
+                CommonInventoryItem, {
+                    { PropPresent, true },
+                    { PropPrettyName, dev.getPrettyName() }
+                }
+            },
+            {
+                PciInventoryItem, {
+                    { PropLocation, location },
+                    { PropDeviceID, toHex(dev.deviceId) },
+                    { PropVendorID, toHex(dev.vendorId) },
+                    { PropRevision, toHex<uint8_t>(dev.revision) },
+                    { PropClassCode, toHex<uint32_t>(dev.classCode, 24) }
+                }
+            }
+        }
+    }};
+    return obj;
+    // clang-format on
+}
+
+ObjectBuilder::Object
+    ObjectBuilder::createFromRange(const PciVfRange& range) const
+{
+    const PciDevice first = range.getFunction(0);
+    const PciDevice last = range.getFunction(range.count - 1);
+
+    const std::string objectPath = getRangePath(range.base.getKey());
+    const std::string location =
+        first.getLocation() + '-' + last.getLocation();
+    const std::string prettyName = first.getPrettyName() + " (" +
+                                   std::to_string(range.count) +
+                                   " virtual functions)";
+    // clang-format off
+    Object obj = {{
+        objectPath, {
+            {
+                CommonInventoryItem, {
+                    { PropPresent, true },
+                    { PropPrettyName, prettyName }
+                }
+            },
+            {
+                PciInventoryItem, {
+                    { PropLocation, location },
+                    { PropDeviceID, toHex(first.deviceId) },
+                    { PropVendorID, toHex(first.vendorId) },
+                    { PropRevision, toHex<uint8_t>(first.revision) },
+                    { PropClassCode, toHex<uint32_t>(first.classCode, 24) }
+                }
+            }
+        }
+    }};
+    return obj;
+    // clang-format on
+}
+
+std::string ObjectBuilder::getDevicePath(uint32_t key) const
+{
+    return root_ + PciDevice(key).getShortName();
+}
+
+std::string ObjectBuilder::getRangePath(uint32_t key) const
+{
+    return root_ + PciDevice(key).getShortName() + VfRangeSuffix;
+}
+
+ObjectBuilder::Object ObjectBuilder::createEmpty(const std::string& path)
+{
+    // clang-format off
+    Object obj = {{
+        path, {
+            {
+                CommonInventoryItem, {
+                    { PropPresent, false },
+                    { PropPrettyName, std::string() }
+                }
+            },
+            {
+                PciInventoryItem, {
+                    { PropLocation, std::string() },
+                    { PropDeviceID, std::string() },
+                    { PropVendorID, std::string() },
+                    { PropRevision, std::string() },
+                    { PropClassCode, std::string() }
+                }
+            }
+        }
+    }};
+    return obj;
+    // clang-format on
+}
@@ -0,0 +1,152 @@
+/**
+ * @brief Builder of PCI inventory objects.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "pcidevice.hpp"
+
+#include <map>
+#include <optional>
+#include <sdbusplus/message.hpp>
+#include <string>
+#include <vector>
+
+/** @struct ObjectRecords
+ *  @brief Compact descriptions of inventory objects, only the latest state
+ *         of each object is kept. Empty description means that the object is
+ *         removed.
+ */
+struct ObjectRecords
+{
+    /** @brief Check if there are no records.
+     *
+     *  @return true if the set is empty
+     */
+    bool empty() const;
+
+    /** @brief Get number of records.
+     *
+     *  @return number of records
+     */
+    size_t size() const;
+
+    /** @brief Remove all records. */
+    void clear();
+
+    /** @brief Move newer records into the set, replacing the existing
+     *         records of the same objects.
+     *
+     *  @param[in] newer - records to move
+     */
+    void merge(ObjectRecords&& newer);
+
+    /** @brief Split the first records off the set.
+     *
+     *  @param[in] number - maximum number of records to split off
+     *
+     *  @return the first records, the rest remains in this set
+     */
+    ObjectRecords split(size_t number);
+
+    /** @brief PCI functions by key. */
+    std::map<uint32_t, std::optional<PciDevice>> devices;
+    /** @brief Aggregate VF range objects by physical function key. */
+    std::map<uint32_t, std::optional<PciVfRange>> ranges;
+};
+
+/** @class ObjectBuilder
+ *  @brief Constructs DBus objects of the host's PCI inventory subtree.
+ *
+ *  All text properties are built here, so the builder is called only for
+ *  the objects which are really written to the inventory.
+ */
+class ObjectBuilder
+{
+  public:
+    using Properties =
+        std::map<std::string, sdbusplus::message::variant<std::string, bool>>;
+    using Interfaces = std::map<std::string, Properties>;
+    using Object = std::map<sdbusplus::message::object_path, Interfaces>;
+
+    /** @brief Constructor.
+     *
+     *  @param[in] channel - IPMI channel number of the host
+     */
+    ObjectBuilder(uint8_t channel);
+
+    /** @brief Get root of the host's PCI inventory subtree.
+     *
+     *  @return path to the subtree, relative to the inventory root
+     */
+    const std::string& getRoot() const;
+
+    /** @brief Construct inventory objects from records.
+     *
+     *  @param[in] records - object records
+     *  @param[out] removed - paths to the removed objects, nullptr to create
+     *                        empty objects for them
+     *
+     *  @return inventory objects
+     */
+    Object createObjects(const ObjectRecords& records,
+                         std::vector<std::string>* removed) const;
+
+    /** @brief Create an inventory object from PCI device description.
+     *
+     *  @param[in] obj - PCI device description
+     *
+     *  @return inventory object
+     */
+    Object createFromDevice(const PciDevice& dev) const;
+
+    /** @brief Create an aggregate inventory object for VF range.
+     *
+     *  @param[in] range - virtual functions range
+     *
+     *  @return inventory object
+     */
+    Object createFromRange(const PciVfRange& range) const;
+
+    /** @brief Create an empty inventory object.
+     *
+     *  @param[in] path - path to the PCI device object description
+     *
+     *  @return inventory object
+     */
+    static Object createEmpty(const std::string& path);
+
+    /** @brief Construct path to the PCI device object.
+     *
+     *  @param[in] key - key of the PCI function
+     *
+     *  @return path to the object
+     */
+    std::string getDevicePath(uint32_t key) const;
+
+    /** @brief Construct path to the aggregate VF range object.
+     *
+     *  @param[in] key - key of the physical function
+     *
+     *  @return path to the object
+     */
+    std::string getRangePath(uint32_t key) const;
+
+  private:
+    /** @brief Root of the host's PCI inventory subtree. */
+    std::string root_;
+};
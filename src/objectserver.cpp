@@ -0,0 +1,194 @@
+/**
+ * @brief DBus object server of the PCI inventory.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "objectserver.hpp"
+
+#include <type_traits>
+
+/** DBus inventory root */
+static const char* InventoryPath = "/xyz/openbmc_project/inventory";
+
+/** @brief Set properties of the object's interface without emitting signals.
+ *
+ *  @param[in] iface - interface of the object
+ *  @param[in] props - properties to set
+ *  @param[out] changed - names of properties which values were changed
+ */
+template <typename Iface>
+static void setProperties(Iface& iface, const ObjectServer::Properties& props,
+                          std::vector<std::string>& changed)
+{
+    using Variant = typename Iface::PropertiesVariant;
+
+    for (const auto& prop : props)
+    {
+        std::visit(
+            [&](const auto& val) {
+                using Value = std::decay_t<decltype(val)>;
+                if constexpr (std::is_constructible_v<Variant, Value>)
+                {
+                    const Variant value(val);
+                    if (iface.getPropertyByName(prop.first) != value)
+                    {
+                        iface.setPropertyByName(prop.first, value, true);
+                        changed.push_back(prop.first);
+                    }
+                }
+            },
+            prop.second);
+    }
+}
+
+/** @brief Emit single PropertiesChanged signal for all changed properties.
+ *
+ *  @param[in] bus - DBus connection
+ *  @param[in] path - object path
+ *  @param[in] iface - interface name
+ *  @param[in] names - names of changed properties
+ */
+static void emitChanged(sdbusplus::bus::bus& bus, const std::string& path,
+                        const char* iface,
+                        const std::vector<std::string>& names)
+{
+    if (names.empty())
+    {
+        return;
+    }
+    std::vector<char*> strv;
+    for (const auto& name : names)
+    {
+        strv.push_back(const_cast<char*>(name.c_str()));
+    }
+    strv.push_back(nullptr);
+    sd_bus_emit_properties_changed_strv(bus.get(), path.c_str(), iface,
+                                        strv.data());
+}
+
+ObjectServer::ObjectServer(Service& service) : service_(service)
+{
+    service_.post([this](sdbusplus::bus::bus& bus) {
+        manager_.emplace(bus, InventoryPath);
+    });
+}
+
+void ObjectServer::publish(Object&& objects)
+{
+    auto batch = std::make_shared<Object>(std::move(objects));
+    service_.post([this, batch](sdbusplus::bus::bus& bus) {
+        applyObjects(bus, *batch);
+    });
+}
+
+void ObjectServer::markStale(const std::string& root)
+{
+    service_.post([this, root](sdbusplus::bus::bus&) { markObjects(root); });
+}
+
+void ObjectServer::sweep(const std::string& root)
+{
+    service_.post([this, root](sdbusplus::bus::bus&) { sweepObjects(root); });
+}
+
+void ObjectServer::erase(std::vector<std::string>&& paths)
+{
+    auto objects = std::make_shared<std::vector<std::string>>(std::move(paths));
+    service_.post(
+        [this, objects](sdbusplus::bus::bus&) { eraseObjects(*objects); });
+}
+
+void ObjectServer::applyObjects(sdbusplus::bus::bus& bus,
+                                const Object& objects)
+{
+    std::vector<PciObject*> added;
+
+    for (const auto& object : objects)
+    {
+        const std::string path = InventoryPath + std::string(object.first);
+        auto it = objects_.find(path);
+        const bool isNew = it == objects_.end();
+        stale_.erase(path);
+        if (isNew)
+        {
+            // Signals are deferred until the whole batch is applied
+            it = objects_
+                     .emplace(path, std::make_unique<PciObject>(
+                                        bus, path.c_str(), true))
+                     .first;
+            added.push_back(it->second.get());
+        }
+
+        PciObject& obj = *it->second;
+        for (const auto& iface : object.second)
+        {
+            std::vector<std::string> changed;
+            if (iface.first == ItemIface::interface)
+            {
+                setProperties<ItemIface>(obj, iface.second, changed);
+            }
+            else if (iface.first == PciIface::interface)
+            {
+                setProperties<PciIface>(obj, iface.second, changed);
+            }
+            if (!isNew)
+            {
+                emitChanged(bus, path, iface.first.c_str(), changed);
+            }
+        }
+    }
+
+    for (auto obj : added)
+    {
+        obj->emit_object_added();
+    }
+}
+
+void ObjectServer::markObjects(const std::string& root)
+{
+    const std::string subtree = InventoryPath + root;
+    for (auto it = objects_.lower_bound(subtree);
+         it != objects_.end() &&
+         it->first.compare(0, subtree.length(), subtree) == 0;
+         ++it)
+    {
+        stale_.insert(it->first);
+    }
+}
+
+void ObjectServer::sweepObjects(const std::string& root)
+{
+    const std::string subtree = InventoryPath + root;
+    auto it = stale_.lower_bound(subtree);
+    while (it != stale_.end() &&
+           it->compare(0, subtree.length(), subtree) == 0)
+    {
+        // Destructor emits InterfacesRemoved signal
+        objects_.erase(*it);
+        it = stale_.erase(it);
+    }
+}
+
+void ObjectServer::eraseObjects(const std::vector<std::string>& paths)
+{
+    for (const auto& path : paths)
+    {
+        // Destructor emits InterfacesRemoved signal
+        const std::string fullPath = InventoryPath + path;
+        objects_.erase(fullPath);
+        stale_.erase(fullPath);
+    }
+}
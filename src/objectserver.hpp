@@ -0,0 +1,127 @@
+/**
+ * @brief DBus object server of the PCI inventory.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "objectbuilder.hpp"
+#include "service.hpp"
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <sdbusplus/server.hpp>
+#include <set>
+#include <string>
+#include <vector>
+#include <xyz/openbmc_project/Inventory/Item/PCI/server.hpp>
+#include <xyz/openbmc_project/Inventory/Item/server.hpp>
+
+/** @class ObjectServer
+ *  @brief DBus object server of the PCI inventory items.
+ *
+ *  Objects are hosted on the connection of the PCI inventory service, all
+ *  changes are posted as tasks to the service thread. Signals about new and
+ *  changed objects are emitted once the whole batch of objects is applied.
+ *  The service thread must be stopped before the server is destroyed.
+ */
+class ObjectServer
+{
+  public:
+    using Properties = ObjectBuilder::Properties;
+    using Interfaces = ObjectBuilder::Interfaces;
+    using Object = ObjectBuilder::Object;
+
+    /** @brief Constructor, registers object manager of the inventory root.
+     *
+     *  @param[in] service - PCI inventory service hosting objects
+     */
+    ObjectServer(Service& service);
+
+    /** @brief Create or update objects, updated objects are not stale
+     *         anymore.
+     *
+     *  @param[in] objects - objects description, paths are relative to the
+     *                       inventory root
+     */
+    void publish(Object&& objects);
+
+    /** @brief Mark all objects in the subtree as stale, they are kept on the
+     *         bus until they are swept.
+     *
+     *  @param[in] root - subtree root, relative to the inventory root
+     */
+    void markStale(const std::string& root);
+
+    /** @brief Remove stale objects in the subtree.
+     *
+     *  @param[in] root - subtree root, relative to the inventory root
+     */
+    void sweep(const std::string& root);
+
+    /** @brief Remove objects.
+     *
+     *  @param[in] paths - paths of objects, relative to the inventory root
+     */
+    void erase(std::vector<std::string>&& paths);
+
+  private:
+    using ItemIface = sdbusplus::xyz::openbmc_project::Inventory::server::Item;
+    using PciIface =
+        sdbusplus::xyz::openbmc_project::Inventory::Item::server::PCI;
+    using PciObject = sdbusplus::server::object::object<ItemIface, PciIface>;
+
+    /** @brief Apply the batch of objects, called from the service thread.
+     *
+     *  @param[in] bus - DBus connection
+     *  @param[in] objects - objects description
+     */
+    void applyObjects(sdbusplus::bus::bus& bus, const Object& objects);
+
+    /** @brief Mark subtree as stale, called from the service thread.
+     *
+     *  @param[in] root - subtree root, relative to the inventory root
+     */
+    void markObjects(const std::string& root);
+
+    /** @brief Remove stale objects of subtree, called from the service
+     *         thread.
+     *
+     *  @param[in] root - subtree root, relative to the inventory root
+     */
+    void sweepObjects(const std::string& root);
+
+    /** @brief Remove objects, called from the service thread.
+     *
+     *  @param[in] paths - paths of objects, relative to the inventory root
+     */
+    void eraseObjects(const std::vector<std::string>& paths);
+
+  private:
+    /** @brief PCI inventory service. */
+    Service& service_;
+    /** @brief Object manager of the inventory root, created by the service
+     *         thread.
+     */
+    std::optional<sdbusplus::server::manager::manager> manager_;
+    /** @brief Hosted objects, key is a full object path. */
+    std::map<std::string, std::unique_ptr<PciObject>> objects_;
+    /** @brief Paths of hosted objects which haven't been published since
+     *         the reset of their subtree.
+     */
+    std::set<std::string> stale_;
+};
@@ -18,32 +18,102 @@
 
 #include "pcidevice.hpp"
 
-#include <stdio.h>
+#include "format.hpp"
 
-PciDevice::PciDevice(const IpmiPciDevice& dev) : IpmiPciDevice(dev)
+#include <endian.h>
+
+/** Maximum device number */
+constexpr uint8_t MAX_DEVICE = 0x1f;
+/** Maximum function number */
+constexpr uint8_t MAX_FUNCTION = 0x07;
+/** Maximum class code (24 bits) */
+constexpr uint32_t MAX_CLASS_CODE = 0xffffff;
+
+/** @brief Pack PCI address from IPMI message into the device key.
+ *         The address must be checked by PciDevice::isValid.
+ *
+ *  @param[in] dev - PCI device description from IPMI message
+ *
+ *  @return domain number and Routing Id packed into 32-bit value
+ */
+static uint32_t packKey(const IpmiPciDevice& dev)
+{
+    return (static_cast<uint32_t>(be16toh(dev.domainNumber)) << 16) |
+           (static_cast<uint32_t>(dev.busNumber) << 8) |
+           (static_cast<uint32_t>(dev.deviceNumber) << 3) | dev.functionNumber;
+}
+
+PciDevice::PciDevice(const IpmiPciDevice& dev) :
+    key(packKey(dev)), vendorId(be16toh(dev.vendorId)),
+    deviceId(be16toh(dev.deviceId)), classCode(be32toh(dev.classCode)),
+    revision(dev.revision)
+{
+    // Original IPMI packet contains data in BE byte order
+}
+
+PciDevice::PciDevice(uint32_t key) :
+    key(key), vendorId(0), deviceId(0), classCode(0), revision(0)
+{
+}
+
+bool PciDevice::isValid(const IpmiPciDevice& dev)
+{
+    return dev.deviceNumber <= MAX_DEVICE &&
+           dev.functionNumber <= MAX_FUNCTION &&
+           be32toh(dev.classCode) <= MAX_CLASS_CODE;
+}
+
+uint32_t PciDevice::getKey() const
+{
+    return key;
+}
+
+uint16_t PciDevice::getDomain() const
+{
+    return key >> 16;
+}
+
+uint8_t PciDevice::getBus() const
+{
+    return (key >> 8) & 0xff;
+}
+
+uint8_t PciDevice::getDevice() const
 {
-    // Convert PCI device description to native structure,
-    // original IPMI packet contains data in BE byte order
-    domainNumber = be16toh(domainNumber);
-    vendorId = be16toh(vendorId);
-    deviceId = be16toh(deviceId);
-    classCode = be32toh(classCode);
+    return (key >> 3) & 0x1f;
+}
+
+uint8_t PciDevice::getFunction() const
+{
+    return key & 0x07;
 }
 
 std::string PciDevice::getShortName() const
 {
-    char name[16];
-    snprintf(name, sizeof(name), "PCI%04x%02x%02x%x", domainNumber, busNumber,
-             deviceNumber, functionNumber);
-    return name;
+    char name[BDF_TEXT_SIZE];
+    char location[BDF_TEXT_SIZE];
+    const size_t len = formatBdf(getDomain(), getBus(), getDevice(),
+                                 getFunction(), name, location);
+    return std::string(name, len);
 }
 
 std::string PciDevice::getLocation() const
 {
-    char location[16];
-    snprintf(location, sizeof(location), "%04x:%02x:%02x.%x", domainNumber,
-             busNumber, deviceNumber, functionNumber);
-    return location;
+    char name[BDF_TEXT_SIZE];
+    char location[BDF_TEXT_SIZE];
+    const size_t len = formatBdf(getDomain(), getBus(), getDevice(),
+                                 getFunction(), name, location);
+    return std::string(location, len);
+}
+
+void PciDevice::getNames(std::string& shortName, std::string& location) const
+{
+    char nameText[BDF_TEXT_SIZE];
+    char locationText[BDF_TEXT_SIZE];
+    const size_t len = formatBdf(getDomain(), getBus(), getDevice(),
+                                 getFunction(), nameText, locationText);
+    shortName.assign(nameText, len);
+    location.assign(locationText, len);
 }
 
 std::string PciDevice::getPrettyName() const
@@ -233,3 +303,62 @@ std::string PciDevice::getPrettyName() const
     }
     // clang-format on
 }
+
+PciVfRange::PciVfRange(const IpmiPciVfMessage& msg) :
+    base(msg.device), count(be16toh(msg.vfCount)),
+    offset(be16toh(msg.vfOffset)), stride(be16toh(msg.vfStride))
+{
+}
+
+bool PciVfRange::isValid() const
+{
+    // Zero offset gives the first VF the address of its physical function
+    if (!count || !offset || (count > 1 && !stride))
+    {
+        return false;
+    }
+    // Routing Id of the last VF must not exceed the bus numbers space
+    const uint32_t last = (base.getKey() & 0xffff) + offset +
+                          static_cast<uint32_t>(count - 1) * stride;
+    return last <= 0xffff;
+}
+
+PciDevice PciVfRange::getFunction(uint16_t index) const
+{
+    const uint32_t rid = (base.getKey() & 0xffff) + offset +
+                         static_cast<uint32_t>(index) * stride;
+
+    PciDevice vf = base;
+    vf.key = (base.getKey() & 0xffff0000) | rid;
+    return vf;
+}
+
+bool PciVfRange::overlaps(uint32_t first, uint32_t last) const
+{
+    // Keys of VFs form an arithmetic progression, find its first member
+    // which is not less than the first key of the interval
+    const uint32_t head = getFunction(0).getKey();
+    uint32_t index = 0;
+    if (head < first)
+    {
+        if (!stride)
+        {
+            return false;
+        }
+        index = (first - head + stride - 1) / stride;
+    }
+    return index < count && head + index * stride <= last;
+}
+
+PciVfRange PciVfRange::split(uint16_t number)
+{
+    PciVfRange head = *this;
+    head.count = number;
+    count -= number;
+    if (count)
+    {
+        // Routing Id of the next VF fits the range, so does its offset
+        offset = static_cast<uint16_t>(offset + number * stride);
+    }
+    return head;
+}
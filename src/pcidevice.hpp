@@ -24,15 +24,64 @@
 
 /** @struct PciDevice
  *  @brief PCI device description.
+ *         The description is kept in a compact native form, all text
+ *         properties are constructed on demand when the device is published.
  */
-struct PciDevice : public IpmiPciDevice
+struct PciDevice
 {
     /** @brief Constructor.
      *
-     *  @param[in] dev - base PCI device description
+     *  @param[in] dev - PCI device description from IPMI message
      */
     PciDevice(const IpmiPciDevice& dev);
 
+    /** @brief Constructor, creates description of PCI address only.
+     *
+     *  @param[in] key - key of the PCI function (see getKey)
+     */
+    explicit PciDevice(uint32_t key);
+
+    /** @brief Check if the description from IPMI message fits the native
+     *         form without losing bits.
+     *
+     *  @param[in] dev - PCI device description from IPMI message
+     *
+     *  @return false if device or function number, or class code is out of
+     *          range
+     */
+    static bool isValid(const IpmiPciDevice& dev);
+
+    /** @brief Get unique key of the PCI function.
+     *
+     *  @return domain number and Routing Id (bus, device and function
+     *          numbers) packed into 32-bit value
+     */
+    uint32_t getKey() const;
+
+    /** @brief Get PCI domain number.
+     *
+     *  @return domain number
+     */
+    uint16_t getDomain() const;
+
+    /** @brief Get PCI bus number.
+     *
+     *  @return bus number
+     */
+    uint8_t getBus() const;
+
+    /** @brief Get PCI device number.
+     *
+     *  @return device number
+     */
+    uint8_t getDevice() const;
+
+    /** @brief Get PCI function number.
+     *
+     *  @return function number
+     */
+    uint8_t getFunction() const;
+
     /** @brief Construct short unique name of the PCI device.
      *         Used as Device name in the inventory.
      *
@@ -46,9 +95,84 @@ struct PciDevice : public IpmiPciDevice
      */
     std::string getLocation() const;
 
+    /** @brief Construct short name and location of the PCI device at once.
+     *         Cheaper than separate calls of getShortName and getLocation.
+     *
+     *  @param[out] shortName - short name
+     *  @param[out] location - PCI device location
+     */
+    void getNames(std::string& shortName, std::string& location) const;
+
     /** @brief Construct pretty name of the PCI device.
      *
      *  @return pretty name of PCI device
      */
     std::string getPrettyName() const;
+
+    /** @brief Domain number and Routing Id of the function. */
+    uint32_t key;
+    /** @brief Vendor ID. */
+    uint16_t vendorId;
+    /** @brief Device ID. */
+    uint16_t deviceId;
+    /** @brief Class code. */
+    uint32_t classCode : 24;
+    /** @brief Revision. */
+    uint32_t revision : 8;
+};
+
+/** @struct PciVfRange
+ *  @brief Range of SR-IOV virtual functions, stored without expanding it to
+ *         separate PCI device descriptions.
+ */
+struct PciVfRange
+{
+    /** @brief Constructor.
+     *
+     *  @param[in] msg - IPMI message with VF range description
+     */
+    PciVfRange(const IpmiPciVfMessage& msg);
+
+    /** @brief Check if the range describes valid PCI addresses.
+     *
+     *  @return false if the range is empty, overlaps the physical function
+     *          or exceeds the bus numbers space
+     */
+    bool isValid() const;
+
+    /** @brief Construct description of the virtual function.
+     *
+     *  @param[in] index - index of the virtual function in the range
+     *
+     *  @return PCI device description
+     */
+    PciDevice getFunction(uint16_t index) const;
+
+    /** @brief Check if any virtual function of the range is in the keys
+     *         interval.
+     *
+     *  @param[in] first - first key of the interval (see PciDevice::getKey)
+     *  @param[in] last - last key of the interval
+     *
+     *  @return true if key of at least one VF is within [first, last]
+     */
+    bool overlaps(uint32_t first, uint32_t last) const;
+
+    /** @brief Split the first virtual functions off the range.
+     *
+     *  @param[in] number - number of VFs to split off, must not exceed the
+     *                      number of VFs in the range
+     *
+     *  @return range of the first VFs, the rest of VFs remains in this range
+     */
+    PciVfRange split(uint16_t number);
+
+    /** @brief Physical function address and VF description. */
+    PciDevice base;
+    /** @brief Number of virtual functions. */
+    uint16_t count;
+    /** @brief Offset of the first VF Routing Id. */
+    uint16_t offset;
+    /** @brief Distance between Routing Ids of consecutive VFs. */
+    uint16_t stride;
 };
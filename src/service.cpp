@@ -0,0 +1,267 @@
+/**
+ * @brief DBus service of the PCI inventory.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "service.hpp"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <phosphor-logging/log.hpp>
+
+using namespace phosphor::logging;
+
+/** DBus service name */
+static const char* ServiceName = "xyz.openbmc_project.PciInventory";
+/** DBus inventory manager service */
+static const char* InventoryService = "xyz.openbmc_project.Inventory.Manager";
+/** DBus status object */
+static const char* StatusPath = "/xyz/openbmc_project/pci_inventory";
+static const char* StatusIface = "xyz.openbmc_project.PciInventory.Status";
+
+/** @brief Status property getter.
+ *
+ *  @param[in] reply - reply message to append the property value
+ *  @param[in] context - pointer to the status instance
+ *
+ *  @return error code
+ */
+template <std::atomic_uint64_t Status::*Member>
+static int getStatus(sd_bus*, const char*, const char*, const char*,
+                     sd_bus_message* reply, void* context, sd_bus_error*)
+{
+    const Status* status = static_cast<const Status*>(context);
+    const uint64_t value = (status->*Member).load();
+    return sd_bus_message_append(reply, "t", value);
+}
+
+/** @brief Stall time property getter, the current stall is included.
+ *
+ *  @param[in] reply - reply message to append the property value
+ *  @param[in] context - pointer to the status instance
+ *
+ *  @return error code
+ */
+static int getStallTime(sd_bus*, const char*, const char*, const char*,
+                        sd_bus_message* reply, void* context, sd_bus_error*)
+{
+    const Status* status = static_cast<const Status*>(context);
+    const uint64_t value = status->getStallTime();
+    return sd_bus_message_append(reply, "t", value);
+}
+
+/** @brief Circuit breaker state property getter.
+ *
+ *  @param[in] reply - reply message to append the property value
+ *  @param[in] context - pointer to the status instance
+ *
+ *  @return error code
+ */
+static int getBreakerState(sd_bus*, const char*, const char*, const char*,
+                           sd_bus_message* reply, void* context, sd_bus_error*)
+{
+    const Status* status = static_cast<const Status*>(context);
+    const char* state;
+    switch (status->breaker.load())
+    {
+        case Status::Breaker::closed:
+            state = "Closed";
+            break;
+        case Status::Breaker::open:
+            state = "Open";
+            break;
+        default:
+            state = "HalfOpen";
+            break;
+    }
+    return sd_bus_message_append(reply, "s", state);
+}
+
+/** Status object vtable */
+static const sdbusplus::vtable::vtable_t statusVtable[] = {
+    sdbusplus::vtable::start(),
+    sdbusplus::vtable::property("RepublishCount", "t",
+                                getStatus<&Status::republishCount>),
+    sdbusplus::vtable::property("RepublishTime", "t",
+                                getStatus<&Status::republishTime>),
+    sdbusplus::vtable::property("BreakerState", "s", getBreakerState),
+    sdbusplus::vtable::property("StallTime", "t", getStallTime),
+    sdbusplus::vtable::end()};
+
+Service::Service(const Status& status, Callback&& onManagerStarted) :
+    status_(status), onManagerStarted_(std::move(onManagerStarted)),
+    eventFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    thread_ = std::thread(&Service::serviceThread, this);
+}
+
+Service::~Service()
+{
+    stop();
+    close(eventFd_);
+}
+
+void Service::post(Task&& task)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (failed_)
+    {
+        return;
+    }
+    tasks_.push_back(std::move(task));
+    lock.unlock();
+
+    wakeUp();
+}
+
+void Service::stop()
+{
+    pendingCancel_.store(true);
+    wakeUp();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+bool Service::connect()
+{
+    try
+    {
+        bus_.emplace(sdbusplus::bus::new_system());
+        statusIface_.emplace(*bus_, StatusPath, StatusIface, statusVtable,
+                             const_cast<Status*>(&status_));
+        managerWatch_.emplace(
+            *bus_,
+            sdbusplus::bus::match::rules::nameOwnerChanged(InventoryService),
+            [this](sdbusplus::message::message& msg) {
+                std::string name, oldOwner, newOwner;
+                msg.read(name, oldOwner, newOwner);
+                if (!newOwner.empty())
+                {
+                    log<level::INFO>("Inventory manager started",
+                                     entry("OWNER=%s", newOwner.c_str()));
+                    onManagerStarted_();
+                }
+            });
+        bus_->request_name(ServiceName);
+    }
+    catch (const std::exception& e)
+    {
+        log<level::ERR>("Failed to register PCI inventory service",
+                        entry("EXCEPTION=%s", e.what()));
+        return false;
+    }
+    return true;
+}
+
+void Service::wakeUp()
+{
+    const uint64_t inc = 1;
+    if (write(eventFd_, &inc, sizeof(inc)) != sizeof(inc))
+    {
+        log<level::ERR>("Failed to notify PCI inventory service");
+    }
+}
+
+bool Service::wait()
+{
+    sd_bus* bus = bus_->get();
+
+    int timeout = -1;
+    uint64_t usec = 0;
+    if (sd_bus_get_timeout(bus, &usec) >= 0 && usec != UINT64_MAX)
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        const uint64_t now = ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+        timeout = usec > now ? static_cast<int>((usec - now + 999) / 1000) : 0;
+    }
+
+    pollfd fds[2];
+    fds[0].fd = sd_bus_get_fd(bus);
+    fds[0].events = static_cast<short>(sd_bus_get_events(bus));
+    fds[0].revents = 0;
+    fds[1].fd = eventFd_;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
+    if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+    {
+        return false;
+    }
+    if (fds[1].revents & POLLIN)
+    {
+        uint64_t val;
+        while (read(eventFd_, &val, sizeof(val)) > 0)
+        {
+        }
+    }
+    return true;
+}
+
+void Service::serviceThread()
+{
+    if (!connect())
+    {
+        // Nobody will execute tasks, don't let them pile up
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = true;
+        tasks_.clear();
+        return;
+    }
+
+    while (!pendingCancel_)
+    {
+        try
+        {
+            while (bus_->process_discard())
+            {
+            }
+
+            std::vector<Task> tasks;
+            std::unique_lock<std::mutex> lock(mutex_);
+            tasks.swap(tasks_);
+            lock.unlock();
+            for (auto& task : tasks)
+            {
+                task(*bus_);
+            }
+
+            // Flush signals emitted by tasks
+            while (bus_->process_discard())
+            {
+            }
+
+            if (!wait())
+            {
+                log<level::ERR>("Failed to wait for PCI inventory service "
+                                "events");
+                break;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            log<level::ERR>("Unhandled exception at PCI inventory service "
+                            "thread",
+                            entry("EXCEPTION=%s", e.what()));
+        }
+    }
+}
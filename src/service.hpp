@@ -0,0 +1,112 @@
+/**
+ * @brief DBus service of the PCI inventory.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "status.hpp"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <sdbusplus/bus.hpp>
+#include <sdbusplus/bus/match.hpp>
+#include <sdbusplus/server.hpp>
+#include <thread>
+#include <vector>
+
+/** @class Service
+ *  @brief DBus service of the PCI inventory.
+ *
+ *  The service has its own DBus connection and a thread processing it. It
+ *  exposes the inventory status and watches the inventory manager.
+ *  Other threads don't touch the connection, they post tasks which are
+ *  executed in the service thread.
+ *  The connection is opened by the service thread, so a DBus failure doesn't
+ *  break loading of the plug-in, it is only logged.
+ */
+class Service
+{
+  public:
+    using Callback = std::function<void()>;
+    using Task = std::function<void(sdbusplus::bus::bus&)>;
+
+    /** @brief Constructor, starts service thread.
+     *
+     *  @param[in] status - inventory status to expose
+     *  @param[in] onManagerStarted - callback called from the service thread
+     *                                when inventory manager (re)appears on
+     *                                the bus
+     */
+    Service(const Status& status, Callback&& onManagerStarted);
+    ~Service();
+
+    /** @brief Post task to execute it in the service thread.
+     *         Tasks are dropped if the service is not available.
+     *
+     *  @param[in] task - task to execute
+     */
+    void post(Task&& task);
+
+    /** @brief Stop the service thread, pending tasks are dropped. */
+    void stop();
+
+  private:
+    /** @brief Open DBus connection and register the service, called from
+     *         the service thread.
+     *
+     *  @return false if the service can't be registered
+     */
+    bool connect();
+
+    /** @brief Wake up the service thread. */
+    void wakeUp();
+
+    /** @brief Wait for DBus or task events.
+     *
+     *  @return false if waiting failed
+     */
+    bool wait();
+
+    /** @brief Service thread routine. */
+    void serviceThread();
+
+  private:
+    /** @brief Inventory status. */
+    const Status& status_;
+    /** @brief Callback: inventory manager has started. */
+    Callback onManagerStarted_;
+    /** @brief DBus connection. */
+    std::optional<sdbusplus::bus::bus> bus_;
+    /** @brief Status object interface. */
+    std::optional<sdbusplus::server::interface::interface> statusIface_;
+    /** @brief Watcher of the inventory manager's bus name. */
+    std::optional<sdbusplus::bus::match::match> managerWatch_;
+    /** @brief Tasks to execute in the service thread. */
+    std::vector<Task> tasks_;
+    /** @brief Service is not available, tasks are dropped. */
+    bool failed_ = false;
+    /** @brief Synchronization object for task list. */
+    std::mutex mutex_;
+    /** @brief Event descriptor used to wake up the service thread. */
+    int eventFd_;
+    /** @brief Pending event: cancel processing. */
+    std::atomic_bool pendingCancel_ = false;
+    /** @brief Service thread. */
+    std::thread thread_;
+};
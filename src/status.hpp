@@ -0,0 +1,82 @@
+/**
+ * @brief PCI inventory status.
+ *
+ * Copyright (c) 2019 YADRO
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+/** @struct Status
+ *  @brief Runtime status of the PCI inventory, exposed via DBus.
+ *         Updated by working threads, read by the service thread.
+ */
+struct Status
+{
+    /** @brief Circuit breaker states. */
+    enum class Breaker
+    {
+        /** @brief Inventory manager is healthy. */
+        closed,
+        /** @brief Inventory manager is unhealthy, publishing is parked. */
+        open,
+        /** @brief Inventory manager is being probed. */
+        halfOpen
+    };
+
+    /** @brief Number of inventory manager restarts which required to write
+     *         objects again.
+     */
+    std::atomic_uint64_t republishCount = 0;
+    /** @brief Time spent to republish the whole inventory after the last
+     *         inventory manager restart, in microseconds.
+     */
+    std::atomic_uint64_t republishTime = 0;
+    /** @brief State of the inventory manager circuit breaker. */
+    std::atomic<Breaker> breaker = Breaker::closed;
+    /** @brief Total time the publishing was parked, in microseconds.
+     *         Updated when the breaker closes.
+     */
+    std::atomic_uint64_t stallTime = 0;
+    /** @brief Start of the current stall, microseconds of the steady clock,
+     *         zero if the publishing is not parked.
+     */
+    std::atomic_uint64_t stallStart = 0;
+
+    /** @brief Get total time the publishing was parked, including the
+     *         current stall.
+     *
+     *  @return time in microseconds
+     */
+    uint64_t getStallTime() const
+    {
+        uint64_t total = stallTime;
+        const uint64_t start = stallStart;
+        if (start)
+        {
+            const uint64_t now =
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count();
+            if (now > start)
+            {
+                total += now - start;
+            }
+        }
+        return total;
+    }
+};
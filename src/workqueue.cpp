@@ -18,81 +18,607 @@
 
 #include "workqueue.hpp"
 
-#include "inventory.hpp"
-
+#include <algorithm>
 #include <phosphor-logging/log.hpp>
+#include <variant>
 
 using namespace phosphor::logging;
 
-WorkQueue::WorkQueue() : thread_(&WorkQueue::workingThread, this)
+/** Number of working threads */
+constexpr size_t WORKING_THREADS = 2;
+/** Maximum number of inventory objects published by a session at once */
+constexpr size_t SESSION_QUANTUM = 16;
+/** Interval of attempts to write parked objects */
+constexpr std::chrono::seconds RETRY_INTERVAL(5);
+/** Time without host's updates after the reset to consider its list sent */
+constexpr std::chrono::seconds SWEEP_DELAY(10);
+
+/** @struct Removal
+ *  @brief Work item: record removed from the host's PCI device list.
+ */
+template <typename T>
+struct Removal
+{
+    /** @brief Removed record. */
+    T record;
+};
+
+/** @brief Work item, queue record resolved to the full description. */
+using Item = std::variant<PciDevice, PciVfRange, Removal<PciDevice>,
+                          Removal<PciVfRange>>;
+
+/** @brief Apply work item to the inventory.
+ *
+ *  @param[in] inventory - host's inventory
+ *  @param[in] item - work item
+ */
+static void apply(Inventory& inventory, const PciDevice& item)
+{
+    inventory.add(item);
+}
+
+static void apply(Inventory& inventory, const PciVfRange& item)
+{
+    inventory.add(item);
+}
+
+template <typename T>
+static void apply(Inventory& inventory, const Removal<T>& item)
+{
+    inventory.remove(item.record);
+}
+
+/** @brief Take the next slice of VF range to apply it to the inventory.
+ *
+ *  @param[in,out] rest - the rest of VF range, the slice is removed from it
+ *  @param[in] budget - maximum number of inventory objects in the slice
+ *  @param[out] objects - number of inventory objects in the slice
+ *
+ *  @return slice of the range
+ */
+static PciVfRange takeSlice(PciVfRange& rest, [[maybe_unused]] size_t budget,
+                            size_t& objects)
+{
+#ifdef PCIINV_VF_AGGREGATE
+    // The whole range is published as a single aggregate object
+    objects = 1;
+    return rest.split(rest.count);
+#else
+    objects = std::min<size_t>(rest.count, budget);
+    return rest.split(static_cast<uint16_t>(objects));
+#endif
+}
+
+/** @brief Check if two PCI functions have the same description.
+ *
+ *  @param[in] lhs - first PCI function
+ *  @param[in] rhs - second PCI function
+ *
+ *  @return true if identifiers, class code and revision are equal
+ */
+static bool sameDescription(const PciDevice& lhs, const PciDevice& rhs)
+{
+    return lhs.vendorId == rhs.vendorId && lhs.deviceId == rhs.deviceId &&
+           lhs.classCode == rhs.classCode && lhs.revision == rhs.revision;
+}
+
+WorkQueue::WorkQueue() :
+    breaker_(status_, [this]() { resume(); }),
+    service_(status_, [this]() { republish(); })
+#ifdef PCIINV_OBJECT_SERVER
+    ,
+    server_(service_)
+#endif
 {
+    for (size_t i = 0; i < WORKING_THREADS; ++i)
+    {
+        threads_.emplace_back(&WorkQueue::workingThread, this);
+    }
 }
 
 WorkQueue::~WorkQueue()
 {
-    if (thread_.joinable())
+    cancel();
+    for (auto& thread : threads_)
     {
-        cancel();
-        thread_.join();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
     }
+    // Hosted objects use the service connection, they are destroyed when
+    // the service thread doesn't process it anymore
+    service_.stop();
 }
 
-void WorkQueue::push(const PciDevice& dev)
+bool WorkQueue::push(uint8_t channel, const PciDevice& dev)
 {
     std::unique_lock<std::mutex> lock(mutex_);
-    queue_.push(dev);
+    Session& session = getSession(channel);
+    // The same object would be described twice
+    if (isVirtualFunction(session, dev.getKey()))
+    {
+        return false;
+    }
+    session.devices.insert_or_assign(dev.getKey(), dev);
+    enqueue(session, dev, Record::Type::addDevice);
     lock.unlock();
     cond_.notify_one();
+    return true;
 }
 
-void WorkQueue::reset()
+bool WorkQueue::push(uint8_t channel, const PciVfRange& range)
 {
-    Queue empty;
+    const uint32_t first = range.getFunction(0).getKey();
+    const uint32_t last = range.getFunction(range.count - 1).getKey();
+
     std::unique_lock<std::mutex> lock(mutex_);
-    queue_.swap(queue_);
+    Session& session = getSession(channel);
+    for (auto it = session.devices.lower_bound(first);
+         it != session.devices.end() && it->first <= last; ++it)
+    {
+        if (range.overlaps(it->first, it->first))
+        {
+            return false;
+        }
+    }
+    // Difference with the applied range is found when the record is
+    // processed, so several changes of the range are coalesced
+    session.ranges.insert_or_assign(range.base.getKey(), range);
+    enqueue(session, range.base, Record::Type::syncRange);
     lock.unlock();
+    cond_.notify_one();
+    return true;
+}
 
-    pendingReset_.store(true);
+bool WorkQueue::remove(uint8_t channel, uint32_t key, uint32_t mask)
+{
+    // Matching keys are adjacent in the ordered device lists
+    const uint32_t first = key & mask;
+    const uint32_t last = first | ~mask;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    Session& session = getSession(channel);
+
+    if (first == last && isVirtualFunction(session, first))
+    {
+        return false;
+    }
+
+    auto dev = session.devices.lower_bound(first);
+    while (dev != session.devices.end() && dev->first <= last)
+    {
+        enqueue(session, dev->second, Record::Type::removeDevice);
+        dev = session.devices.erase(dev);
+    }
+
+    // VFs can be far from their physical function, so all ranges are checked
+    auto range = session.ranges.begin();
+    while (range != session.ranges.end())
+    {
+        if ((range->first >= first && range->first <= last) ||
+            range->second.overlaps(first, last))
+        {
+            enqueue(session, range->second.base, Record::Type::syncRange);
+            range = session.ranges.erase(range);
+        }
+        else
+        {
+            ++range;
+        }
+    }
+
+    lock.unlock();
+    cond_.notify_one();
+    return true;
+}
+
+void WorkQueue::reset(uint8_t channel)
+{
+    Queue empty;
+    std::map<uint32_t, PciVfRange> applied;
+    std::unique_lock<std::mutex> lock(mutex_);
+    Session& session = getSession(channel);
+    session.queue.swap(empty);
+    session.devices.clear();
+    session.ranges.clear();
+    session.applied.swap(applied);
+    session.rest.clear();
+    session.pendingReset = true;
+    session.pendingSweep = false;
+#ifdef PCIINV_OBJECT_SERVER
+    // Hosted objects are kept until the host has sent its list again
+    session.sweepTime = std::chrono::steady_clock::now() + SWEEP_DELAY;
+#endif
+    ++session.epoch;
+    schedule(session);
+    lock.unlock();
     cond_.notify_one();
 }
 
+Fingerprint WorkQueue::getFingerprint(uint8_t channel)
+{
+    Fingerprint fp;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sessions_.find(channel);
+    if (it == sessions_.end())
+    {
+        return fp;
+    }
+    const Session& session = *it->second;
+    for (const auto& dev : session.devices)
+    {
+        fp.add(dev.second);
+    }
+    for (const auto& range : session.ranges)
+    {
+        fp.add(range.second);
+    }
+    return fp;
+}
+
+void WorkQueue::republish()
+{
+    // Started manager is a successful probe, the replay mustn't wait for the
+    // cool down of the open breaker. Breaker calls back without our lock.
+    breaker_.success();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    managerStarted_ = std::chrono::steady_clock::now();
+    pendingRepublishCount_ = true;
+    for (auto& it : sessions_)
+    {
+        it.second->pendingRepublish = true;
+        schedule(*it.second);
+    }
+    lock.unlock();
+    cond_.notify_all();
+}
+
 void WorkQueue::cancel()
 {
     pendingCancel_.store(true);
-    cond_.notify_one();
+    std::lock_guard<std::mutex> lock(mutex_);
+    cond_.notify_all();
 }
 
-void WorkQueue::workingThread()
+void WorkQueue::enqueue(Session& session, const PciDevice& device,
+                        Record::Type type)
 {
-    Inventory inv;
+    session.queue.push({device, type});
+    if (session.sweepTime)
+    {
+        session.sweepTime = std::chrono::steady_clock::now() + SWEEP_DELAY;
+    }
+    schedule(session);
+}
 
-    while (!pendingCancel_)
+bool WorkQueue::isVirtualFunction(const Session& session, uint32_t key)
+{
+    for (const auto& it : session.ranges)
     {
-        try
+        if (it.second.overlaps(key, key))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkQueue::syncRange(Session& session, uint32_t key)
+{
+    const auto target = session.ranges.find(key);
+    const auto current = session.applied.find(key);
+
+    if (current == session.applied.end())
+    {
+        // Range removed before it has been applied has nothing to remove
+        if (target != session.ranges.end())
         {
-            if (pendingReset_)
+            session.rest.push_back({target->second, std::nullopt, false});
+            session.applied.emplace(key, target->second);
+        }
+        return;
+    }
+    if (target == session.ranges.end())
+    {
+        session.rest.push_back({current->second, std::nullopt, true});
+        session.applied.erase(current);
+        return;
+    }
+
+    const PciVfRange& from = current->second;
+    const PciVfRange& to = target->second;
+    const bool sameFunctions = from.count == to.count &&
+                               from.offset == to.offset &&
+                               from.stride == to.stride;
+    const bool sameVfs = sameDescription(from.base, to.base);
+#ifdef PCIINV_VF_AGGREGATE
+    // Aggregate object is updated in place
+    if (!sameFunctions || !sameVfs)
+    {
+        session.rest.push_back({to, std::nullopt, false});
+    }
+#else
+    // Only dropped and added VFs are written, VFs kept by the new range are
+    // rewritten if their description is changed
+    if (!sameFunctions)
+    {
+        session.rest.push_back({from, to, true});
+    }
+    if (!sameVfs)
+    {
+        session.rest.push_back({to, std::nullopt, false});
+    }
+    else if (!sameFunctions)
+    {
+        session.rest.push_back({to, from, false});
+    }
+#endif
+    current->second = to;
+}
+
+WorkQueue::Session& WorkQueue::getSession(uint8_t channel)
+{
+    auto it = sessions_.find(channel);
+    if (it == sessions_.end())
+    {
+        log<level::INFO>("New PCI inventory session",
+                         entry("CHANNEL=%u", channel));
+#ifdef PCIINV_OBJECT_SERVER
+        ObjectServer* server = &server_;
+#else
+        ObjectServer* server = nullptr;
+#endif
+        auto session = std::make_unique<Session>(channel, server, breaker_);
+        it = sessions_.emplace(channel, std::move(session)).first;
+    }
+    return *it->second;
+}
+
+void WorkQueue::schedule(Session& session)
+{
+    if (!session.scheduled)
+    {
+        session.scheduled = true;
+        ready_.push_back(&session);
+    }
+}
+
+void WorkQueue::retryParked()
+{
+    for (auto& it : sessions_)
+    {
+        Session& session = *it.second;
+        if (session.parked)
+        {
+            session.pendingRetry = true;
+            schedule(session);
+        }
+    }
+}
+
+void WorkQueue::sweepStale(std::chrono::steady_clock::time_point now)
+{
+    for (auto& it : sessions_)
+    {
+        Session& session = *it.second;
+        if (session.sweepTime && now >= *session.sweepTime)
+        {
+            session.sweepTime.reset();
+            session.pendingSweep = true;
+            schedule(session);
+        }
+    }
+}
+
+void WorkQueue::resume()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    retryParked();
+    lock.unlock();
+    cond_.notify_all();
+}
+
+void WorkQueue::process(Session& session)
+{
+    bool doReset = false;
+    bool doRepublish = false;
+    std::vector<Item> items;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint32_t epoch = session.epoch;
+    const auto managerStarted = managerStarted_;
+    if (session.pendingReset)
+    {
+        session.pendingReset = false;
+        doReset = true;
+    }
+    if (session.pendingRepublish)
+    {
+        session.pendingRepublish = false;
+        doRepublish = true;
+    }
+    session.pendingRetry = false;
+    // Quantum is charged by inventory objects, VFs of a range are applied
+    // in slices on several turns
+    size_t objects = 0;
+    while (objects < SESSION_QUANTUM)
+    {
+        if (!session.rest.empty())
+        {
+            RangeWork& work = session.rest.front();
+            if (work.except)
             {
-                pendingReset_ = false;
-                inv.reset();
-                continue;
+                // VFs are checked one by one, skipped VFs cost nothing
+                while (work.range.count && objects < SESSION_QUANTUM)
+                {
+                    const PciDevice vf = work.range.split(1).getFunction(0);
+                    if (work.except->overlaps(vf.getKey(), vf.getKey()))
+                    {
+                        continue;
+                    }
+                    if (work.removal)
+                    {
+                        items.emplace_back(Removal<PciDevice>{vf});
+                    }
+                    else
+                    {
+                        items.emplace_back(vf);
+                    }
+                    ++objects;
+                }
             }
-            std::unique_lock<std::mutex> lock(mutex_);
-            if (queue_.empty())
+            else
             {
-                cond_.wait(lock);
+                size_t sliceObjects;
+                const PciVfRange slice = takeSlice(
+                    work.range, SESSION_QUANTUM - objects, sliceObjects);
+                if (work.removal)
+                {
+                    items.emplace_back(Removal<PciVfRange>{slice});
+                }
+                else
+                {
+                    items.emplace_back(slice);
+                }
+                objects += sliceObjects;
             }
-            else
+            if (!work.range.count)
             {
-                const PciDevice dev = queue_.front();
-                queue_.pop();
-                lock.unlock();
-                inv.add(dev);
+                session.rest.pop_front();
             }
+            continue;
+        }
+        if (session.queue.empty())
+        {
+            break;
+        }
+
+        const Record& record = session.queue.front();
+        switch (record.type)
+        {
+            case Record::Type::addDevice:
+                items.emplace_back(record.device);
+                ++objects;
+                break;
+            case Record::Type::removeDevice:
+                items.emplace_back(Removal<PciDevice>{record.device});
+                ++objects;
+                break;
+            case Record::Type::syncRange:
+                syncRange(session, record.device.getKey());
+                break;
+        }
+        session.queue.pop();
+    }
+    // Objects sent again must be written before the stale ones are removed
+    bool doSweep = false;
+    if (session.pendingSweep && session.queue.empty() && session.rest.empty())
+    {
+        session.pendingSweep = false;
+        doSweep = true;
+    }
+    lock.unlock();
+
+    if (doReset)
+    {
+        session.inventory.reset();
+    }
+    // Manager's first start and hosted objects don't need republishing
+    bool replayed = false;
+    if (doRepublish && session.inventory.republish())
+    {
+        replayed = true;
+        if (!session.inventory.isParked())
+        {
+            const auto elapsed =
+                std::chrono::steady_clock::now() - managerStarted;
+            status_.republishTime =
+                std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+                    .count();
+        }
+    }
+
+    for (const auto& item : items)
+    {
+        if (pendingCancel_ || session.epoch != epoch)
+        {
+            // Session has been reset, the rest of items is outdated
+            break;
+        }
+        std::visit(
+            [&session](const auto& entry) { apply(session.inventory, entry); },
+            item);
+    }
+
+    // Write the whole batch at once, outdated batch will be dropped by reset
+    if (session.epoch == epoch)
+    {
+        session.inventory.flush();
+        if (doSweep)
+        {
+            session.inventory.sweep();
+        }
+    }
+
+    const bool parked = session.inventory.isParked();
+    lock.lock();
+    session.parked = parked;
+    if (replayed && pendingRepublishCount_)
+    {
+        // Restart is counted once, by the first session replaying objects
+        pendingRepublishCount_ = false;
+        ++status_.republishCount;
+    }
+}
+
+void WorkQueue::workingThread()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true)
+    {
+        // Retry and sweep are driven by the deadline rather than by idle
+        // time, so traffic of other sessions doesn't starve the parked ones
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= nextRetry_)
+        {
+            nextRetry_ = now + RETRY_INTERVAL;
+            retryParked();
+            sweepStale(now);
+        }
+        if (pendingCancel_)
+        {
+            break;
+        }
+        if (ready_.empty())
+        {
+            cond_.wait_until(lock, nextRetry_);
+            continue;
+        }
+
+        Session& session = *ready_.front();
+        ready_.pop_front();
+        lock.unlock();
+
+        try
+        {
+            process(session);
         }
         catch (const std::exception& e)
         {
             log<level::ERR>("Unhandled exception at PCI working thread",
                             entry("EXCEPTION=%s", e.what()));
         }
+
+        // Put session to the end of the ready list if it still has work
+        lock.lock();
+        session.scheduled = false;
+        if (session.hasWork())
+        {
+            schedule(session);
+            cond_.notify_one();
+        }
     }
 }
@@ -18,16 +18,37 @@
 
 #pragma once
 
+#include "breaker.hpp"
+#include "fingerprint.hpp"
+#include "inventory.hpp"
 #include "pcidevice.hpp"
+#include "service.hpp"
+#include "status.hpp"
+#ifdef PCIINV_OBJECT_SERVER
+#include "objectserver.hpp"
+#endif
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include <thread>
+#include <vector>
 
 /** @class WorkQueue
- *  @brief Synchronized FIFO queue, each element processed in a working thread.
+ *  @brief Synchronized FIFO queues of host sessions, each session is processed
+ *         by a pool of working threads.
+ *
+ *  Every host reports its PCI devices over its own IPMI channel, the channel
+ *  number is used as a session identifier. Sessions are independent: each has
+ *  its own queue, epoch and inventory subtree. Working threads take sessions
+ *  in round-robin order and publish a limited number of objects at once, so a
+ *  long device list of one host doesn't hold up the others.
  */
 class WorkQueue
 {
@@ -36,38 +57,278 @@ class WorkQueue
     ~WorkQueue();
 
     /** @brief Push item to queue.
+     *         Description of the device with the same address is replaced.
      *
+     *  @param[in] channel - IPMI channel number of the host session
      *  @param[in] dev - PCI device description to push
+     *
+     *  @return false if the address belongs to a virtual function of a VF
+     *          range, it can't be described apart from its range
+     */
+    bool push(uint8_t channel, const PciDevice& dev);
+
+    /** @brief Push SR-IOV virtual functions range to queue.
+     *         Previous VF range of the same physical function is replaced,
+     *         only VFs which are added or dropped are written.
+     *
+     *  @param[in] channel - IPMI channel number of the host session
+     *  @param[in] range - virtual functions range to push
+     *
+     *  @return false if a VF of the range is already described as a
+     *          separate PCI device
      */
-    void push(const PciDevice& dev);
+    bool push(uint8_t channel, const PciVfRange& range);
+
+    /** @brief Remove PCI devices and VF ranges from the host's list.
+     *         A VF range is removed if its physical function or any of its
+     *         virtual functions matches the key.
+     *
+     *  @param[in] channel - IPMI channel number of the host session
+     *  @param[in] key - key of PCI function (see PciDevice::getKey)
+     *  @param[in] mask - significant bits of the key, all devices with
+     *                    matching key are removed
+     *
+     *  @return false if the single function addressed by the key is a
+     *          virtual function, it can't be removed apart from its range
+     */
+    bool remove(uint8_t channel, uint32_t key, uint32_t mask);
 
     /** @brief Reset PCI device list.
      *         Using to notify the waiting thread that new session has begun.
+     *
+     *  @param[in] channel - IPMI channel number of the host session
+     */
+    void reset(uint8_t channel);
+
+    /** @brief Get fingerprint of the PCI device list received from the host.
+     *         Session is not created by the query.
+     *
+     *  @param[in] channel - IPMI channel number of the host session
+     *
+     *  @return fingerprint of the list, empty one if there is no session
      */
-    void reset();
+    Fingerprint getFingerprint(uint8_t channel);
+
+    /** @brief Republish inventory of all sessions.
+     *         Using to restore the inventory after the inventory manager
+     *         restart.
+     */
+    void republish();
 
     /** @brief Cancel queue processing.
-     *         Using to notify the waiting thread that it must be terminated.
+     *         Using to notify the waiting threads that they must be terminated.
      */
     void cancel();
 
   private:
+    /** @struct Record
+     *  @brief Queue record.
+     *         Records are kept compact, so a long device list or a burst of
+     *         outdated messages costs little until it is really published.
+     *         VF ranges are stored in the session's lists and referenced by
+     *         the physical function key: the range record synchronizes the
+     *         inventory with the latest state of the range.
+     */
+    struct Record
+    {
+        /** @brief Record types. */
+        enum class Type : uint8_t
+        {
+            addDevice,
+            removeDevice,
+            syncRange
+        };
+
+        /** @brief PCI device description, range records use its key only. */
+        PciDevice device;
+        /** @brief Record type. */
+        Type type;
+    };
+    static_assert(sizeof(Record) == 16, "Queue record must be compact");
+
+    using Queue = std::queue<Record>;
+
+    /** @struct RangeWork
+     *  @brief VFs of the range to apply to the inventory on the next turns.
+     */
+    struct RangeWork
+    {
+        /** @brief VFs to apply, applied VFs are split off. */
+        PciVfRange range;
+        /** @brief VFs to skip, they are already in the required state. */
+        std::optional<PciVfRange> except;
+        /** @brief VFs are removed rather than added. */
+        bool removal;
+    };
+
+    /** @struct Session
+     *  @brief Host session state.
+     */
+    struct Session
+    {
+        /** @brief Constructor.
+         *
+         *  @param[in] channel - IPMI channel number of the host
+         *  @param[in] server - object server, nullptr if not used
+         *  @param[in] breaker - circuit breaker of inventory manager calls
+         */
+        Session(uint8_t channel, ObjectServer* server,
+                CircuitBreaker& breaker) :
+            inventory(channel, server, breaker)
+        {
+        }
+
+        /** @brief Check if session has pending work.
+         *
+         *  @return true if there are pending events or queued items
+         */
+        bool hasWork() const
+        {
+            return pendingReset || pendingRepublish || pendingRetry ||
+                   pendingSweep || !queue.empty() || !rest.empty();
+        }
+
+        /** @brief Queue container. */
+        Queue queue;
+        /** @brief PCI devices received since the last reset. */
+        std::map<uint32_t, PciDevice> devices;
+        /** @brief VF ranges received since the last reset. */
+        std::map<uint32_t, PciVfRange> ranges;
+        /** @brief VF ranges as they are applied to the inventory by the
+         *         processed records, including the rest being applied.
+         */
+        std::map<uint32_t, PciVfRange> applied;
+        /** @brief VF ranges being applied, their VFs are applied on the next
+         *         turns before other records.
+         */
+        std::deque<RangeWork> rest;
+        /** @brief Session epoch, incremented on each reset. */
+        std::atomic_uint32_t epoch = 0;
+        /** @brief Pending event: reset PCI device list. */
+        bool pendingReset = false;
+        /** @brief Pending event: republish inventory. */
+        bool pendingRepublish = false;
+        /** @brief Pending event: retry writing parked objects. */
+        bool pendingRetry = false;
+        /** @brief Pending event: remove hosted objects which haven't been
+         *         sent again since the reset.
+         */
+        bool pendingSweep = false;
+        /** @brief Time to sweep hosted objects, it is put off by each
+         *         update while the host is sending its list after the reset.
+         */
+        std::optional<std::chrono::steady_clock::time_point> sweepTime;
+        /** @brief Inventory has parked objects. */
+        bool parked = false;
+        /** @brief Session is in the ready list or being processed. */
+        bool scheduled = false;
+        /** @brief Host's PCI inventory subtree, used by a working thread
+         *         which is processing the session.
+         */
+        Inventory inventory;
+    };
+
+    /** @brief Push record to the session's queue and schedule the session.
+     *         Must be called with locked mutex.
+     *
+     *  @param[in] session - host session
+     *  @param[in] device - PCI device description or key of the range
+     *  @param[in] type - record type
+     */
+    void enqueue(Session& session, const PciDevice& device, Record::Type type);
+
+    /** @brief Compare the latest state of the VF range with the applied one
+     *         and plan the difference as the rest of the session's work.
+     *         Must be called with locked mutex.
+     *
+     *  @param[in] session - host session
+     *  @param[in] key - key of the physical function
+     */
+    static void syncRange(Session& session, uint32_t key);
+
+    /** @brief Check if the address belongs to a VF of the session's ranges.
+     *         Must be called with locked mutex.
+     *
+     *  @param[in] session - host session
+     *  @param[in] key - key of the PCI function
+     *
+     *  @return true if the function is a virtual function
+     */
+    static bool isVirtualFunction(const Session& session, uint32_t key);
+
+    /** @brief Get session, create a new one if it doesn't exist yet.
+     *         Must be called with locked mutex.
+     *
+     *  @param[in] channel - IPMI channel number of the host session
+     *
+     *  @return session instance
+     */
+    Session& getSession(uint8_t channel);
+
+    /** @brief Put session into the ready list if it is not scheduled yet.
+     *         Must be called with locked mutex.
+     *
+     *  @param[in] session - session to schedule
+     */
+    void schedule(Session& session);
+
+    /** @brief Schedule sessions which have parked objects.
+     *         Must be called with locked mutex.
+     */
+    void retryParked();
+
+    /** @brief Schedule sessions which have to sweep hosted objects.
+     *         Must be called with locked mutex.
+     *
+     *  @param[in] now - current time
+     */
+    void sweepStale(std::chrono::steady_clock::time_point now);
+
+    /** @brief Schedule all parked sessions when publishing is resumed by the
+     *         circuit breaker.
+     */
+    void resume();
+
+    /** @brief Process the next portion of the session's work.
+     *
+     *  @param[in] session - session to process
+     */
+    void process(Session& session);
+
     /** @brief Working thread routine. */
     void workingThread();
 
   private:
-    using Queue = std::queue<PciDevice>;
-
-    /** @brief Queue container. */
-    Queue queue_;
-    /** @brief Working thread. */
-    std::thread thread_;
+    /** @brief Inventory status. */
+    Status status_;
+    /** @brief Circuit breaker of inventory manager calls. */
+    CircuitBreaker breaker_;
+    /** @brief Time when the inventory manager has been started. */
+    std::chrono::steady_clock::time_point managerStarted_;
+    /** @brief Pending event: count the inventory manager restart, if any
+     *         session replays its objects.
+     */
+    bool pendingRepublishCount_ = false;
+    /** @brief Host sessions. */
+    std::map<uint8_t, std::unique_ptr<Session>> sessions_;
+    /** @brief Sessions ready to be processed, in round-robin order. */
+    std::deque<Session*> ready_;
+    /** @brief Working threads. */
+    std::vector<std::thread> threads_;
     /** @brief Synchronization object. */
     std::mutex mutex_;
     /** @brief Event notifier. */
     std::condition_variable cond_;
+    /** @brief Time of the next attempt to write parked objects. */
+    std::chrono::steady_clock::time_point nextRetry_;
     /** @brief Pending event: cancel processing. */
     std::atomic_bool pendingCancel_ = false;
-    /** @brief Pending event: reset PCI device list. */
-    std::atomic_bool pendingReset_ = false;
+    /** @brief DBus service, uses the queue in its callbacks, so it must be
+     *         constructed after other members of the queue.
+     */
+    Service service_;
+#ifdef PCIINV_OBJECT_SERVER
+    /** @brief Object server hosting PCI inventory items. */
+    ObjectServer server_;
+#endif
 };